@@ -0,0 +1,158 @@
+#ifndef REASSORTMENT_SIMULATOR_H
+#define REASSORTMENT_SIMULATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct SimulationConfig {
+    size_t num_samples = 1000;
+    size_t num_segments = 8;
+    double mutation_rate = 1.0;       // expected number of new mutations per segment per sample
+    double reassortment_rate = 0.05;  // probability that a sample takes its segments from two parents
+    size_t samples_per_day = 10;
+    uint64_t seed = 1;
+};
+
+// Simulates the evolution of a segmented genome and writes the samples as a mutations CSV
+// ("Date,ID,<segment>,..." with mutations of a segment separated by ':').
+// Every sample descends from a uniformly chosen earlier sample, so the genealogy is a random
+// recursive tree of logarithmic depth. With probability reassortment_rate a second parent is
+// chosen and each segment is taken from either parent with equal probability. Each segment
+// then gains a Poisson(mutation_rate) number of mutations at fresh positions, so mutations
+// are never recurrent. The output depends only on the config: mt19937_64 is fully specified
+// and the distributions are implemented here rather than taken from the standard library.
+class ReassortmentSimulator {
+private:
+    SimulationConfig config;
+    mt19937_64 rng;
+    // Segment genealogies. Sample i carries lineage sample_lineage[seg][i] of segment seg;
+    // a lineage is its parent lineage plus the positions in lineage_muts[lineage_mut_offsets[l] ...]
+    vector<vector<uint32_t>> sample_lineage;
+    vector<vector<uint32_t>> lineage_parent;
+    vector<vector<uint32_t>> lineage_mut_offsets;
+    vector<vector<uint32_t>> lineage_muts;
+    vector<uint32_t> next_position;
+
+    static const uint32_t NO_LINEAGE = UINT32_MAX;
+
+    double uniform() {
+        return (rng() >> 11) * 0x1.0p-53;
+    }
+
+    size_t uniform_index(size_t n) {
+        return rng() % n;
+    }
+
+    size_t poisson(double mean) {
+        double limit = exp(-mean);
+        double product = uniform();
+        size_t count = 0;
+        while (product > limit) {
+            product *= uniform();
+            count++;
+        }
+        return count;
+    }
+
+    static void write_date(ostream& out, size_t day) { // day 0 is 2000-01-01
+        long z = static_cast<long>(day) + 10957 + 719468; // days since 0000-03-01
+        long era = z / 146097;
+        long doe = z - era * 146097;
+        long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        long mp = (5 * doy + 2) / 153;
+        long d = doy - (153 * mp + 2) / 5 + 1;
+        long m = mp < 10 ? mp + 3 : mp - 9;
+        long y = yoe + era * 400 + (m <= 2);
+        out << y << (m < 10 ? "-0" : "-") << m << (d < 10 ? "-0" : "-") << d;
+    }
+
+    static void write_mutation(ostream& out, uint32_t position) {
+        static const char bases[] = "ACGT";
+        uint32_t ref = (position * 7) % 4;
+        uint32_t alt = (ref + 1 + position % 3) % 4;
+        out << bases[ref] << position << bases[alt];
+    }
+
+    void write_segment(ostream& out, size_t seg, uint32_t lineage, vector<uint32_t>& positions) const {
+        positions.clear();
+        for (; lineage != NO_LINEAGE; lineage = lineage_parent[seg][lineage]) {
+            positions.insert(positions.end(), lineage_muts[seg].begin() + lineage_mut_offsets[seg][lineage], lineage_muts[seg].begin() + lineage_mut_offsets[seg][lineage + 1]);
+        }
+        sort(positions.begin(), positions.end());
+        for (size_t i = 0; i < positions.size(); i++) {
+            if (i > 0) {
+                out << ':';
+            }
+            write_mutation(out, positions[i]);
+        }
+    }
+
+public:
+    explicit ReassortmentSimulator(const SimulationConfig& config)
+        : config(config), rng(config.seed) {}
+
+    static string segment_name(size_t seg, size_t num_segments) {
+        static const char * influenza_segments[] = {"PB1", "PB2", "PA", "HA", "NP", "NA", "M1", "NS1"};
+        return num_segments <= 8 ? influenza_segments[seg] : "SEG" + to_string(seg + 1);
+    }
+
+    // Simulates config.num_samples samples and writes them to out in order of sampling
+    void write_csv(ostream& out) {
+        size_t num_segs = config.num_segments;
+        sample_lineage.assign(num_segs, vector<uint32_t>());
+        lineage_parent.assign(num_segs, vector<uint32_t>());
+        lineage_mut_offsets.assign(num_segs, vector<uint32_t>(1, 0));
+        lineage_muts.assign(num_segs, vector<uint32_t>());
+        next_position.assign(num_segs, 1);
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            sample_lineage[seg].reserve(config.num_samples);
+        }
+
+        out << "Date,ID";
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            out << ',' << segment_name(seg, num_segs);
+        }
+        out << '\n';
+
+        vector<uint32_t> positions;
+        for (size_t i = 0; i < config.num_samples; i++) {
+            size_t parent = i > 0 ? uniform_index(i) : 0;
+            size_t second_parent = parent;
+            if (i > 0 && uniform() < config.reassortment_rate) {
+                second_parent = uniform_index(i);
+            }
+            write_date(out, i / max<size_t>(1, config.samples_per_day));
+            out << ",S" << i;
+            for (size_t seg = 0; seg < num_segs; seg++) {
+                uint32_t lineage = NO_LINEAGE;
+                if (i > 0) {
+                    size_t source = (second_parent != parent && uniform() < 0.5) ? second_parent : parent;
+                    lineage = sample_lineage[seg][source];
+                }
+                size_t num_new_muts = poisson(config.mutation_rate);
+                if (num_new_muts > 0) {
+                    lineage_parent[seg].push_back(lineage);
+                    for (size_t k = 0; k < num_new_muts; k++) {
+                        lineage_muts[seg].push_back(next_position[seg]++);
+                    }
+                    lineage_mut_offsets[seg].push_back(lineage_muts[seg].size());
+                    lineage = lineage_parent[seg].size() - 1;
+                }
+                sample_lineage[seg].push_back(lineage);
+                out << ',';
+                write_segment(out, seg, lineage, positions);
+            }
+            out << '\n';
+        }
+    }
+};
+
+#endif // REASSORTMENT_SIMULATOR_H
@@ -0,0 +1,274 @@
+#include "../include/Network.h"
+#include "ReassortmentSimulator.h"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Heap allocations of this process, counted to report the allocator traffic of grafting
+static std::atomic<size_t> num_allocations{0};
+
+__attribute__((noinline)) void * operator new(std::size_t size) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void * ptr = std::malloc(size > 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void * ptr) noexcept { std::free(ptr); }
+__attribute__((noinline)) void operator delete(void * ptr, std::size_t) noexcept { std::free(ptr); }
+
+// Timings of one network size, measured in a child process so that peak RSS is per size
+struct BenchResult {
+    size_t num_samples = 0;
+    size_t num_nodes = 0;
+    size_t parent_child_rejections = 0; // samples left out of the network, which a comparison of node counts must allow for
+    double parse_seconds = 0;
+    double order_seconds = 0;
+    double graft_seconds = 0;
+    double graft_allocations = 0; // heap allocations per grafted sample
+    double search_micros = 0; // mean time of one per-segment search on the final network
+    double write_seconds = 0;
+    double snapshot_save_seconds = 0;
+    double snapshot_load_seconds = 0;
+    long peak_rss_kb = 0; // before the snapshot is reloaded
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs body in a forked child and returns its exit status; the child's stdout goes to /dev/null
+template <typename Body>
+static int run_in_child(Body body) {
+    std::cout.flush();
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int dev_null = open("/dev/null", O_WRONLY);
+        dup2(dev_null, STDOUT_FILENO);
+        _exit(body());
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static BenchResult bench_network(const std::string& csv_filename, const std::string& network_filename, const std::string& snapshot_filename, SampleOrder order, size_t num_threads, size_t num_probes, size_t compact_interval) {
+    BenchResult result;
+    Network net(num_threads);
+    net.set_compact_interval(compact_interval);
+    SampleTable samples;
+
+    auto start = std::chrono::steady_clock::now();
+    net.load_samples(csv_filename, samples);
+    result.parse_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    net.set_sample_order(order); // as --order tells the network, which searches deeper in other orders than the file's
+    samples.reorder(order_samples(samples, order));
+    result.order_seconds = seconds_since(start);
+
+    size_t allocations_before = num_allocations;
+    start = std::chrono::steady_clock::now();
+    net.graft_samples(samples);
+    if (compact_interval > 0) {
+        net.compact();
+    }
+    result.graft_seconds = seconds_since(start);
+    result.graft_allocations = samples.size() > 0 ? double(num_allocations - allocations_before) / samples.size() : 0;
+
+    // Probe the finished network with the mutations of samples spread evenly through the file
+    num_probes = std::min(num_probes, samples.size());
+    size_t num_searches = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_probes; i++) {
+        node_id sample = net.get_node(std::string(samples.id(i * samples.size() / num_probes)));
+        for (size_t seg = 0; seg < net.num_segments(); seg++) {
+            net.get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(sample, seg);
+            num_searches++;
+        }
+    }
+    result.search_micros = num_searches > 0 ? seconds_since(start) * 1e6 / num_searches : 0;
+
+    start = std::chrono::steady_clock::now();
+    net.write_network(network_filename);
+    result.write_seconds = seconds_since(start);
+
+    result.num_samples = samples.size();
+    result.num_nodes = net.num_nodes();
+    result.parent_child_rejections = net.get_stats().parent_child_rejections;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peak_rss_kb = usage.ru_maxrss;
+
+    start = std::chrono::steady_clock::now();
+    net.save_snapshot(snapshot_filename);
+    result.snapshot_save_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    Network reloaded(num_threads);
+    reloaded.load_snapshot(snapshot_filename);
+    result.snapshot_load_seconds = seconds_since(start);
+    return result;
+}
+
+// Builds the network of the samples one by one and in batches of batch_size, both compacting every compact_interval
+// samples, and returns whether the two write the same network (line order aside, as threads may order nodes differently)
+static bool batch_matches_sequential(const std::string& csv_filename, const std::string& network_filename, SampleOrder order, size_t num_threads, size_t batch_size, size_t compact_interval) {
+    std::vector<std::string> networks[2];
+    for (size_t b = 0; b < 2; b++) {
+        Network net(num_threads, b == 0 ? 1 : batch_size);
+        net.set_compact_interval(compact_interval);
+        SampleTable samples;
+        net.load_samples(csv_filename, samples);
+        net.set_sample_order(order);
+        samples.reorder(order_samples(samples, order));
+        net.graft_samples(samples);
+        if (compact_interval > 0) {
+            net.compact();
+        }
+        net.write_network(network_filename);
+        std::ifstream network_file(network_filename);
+        std::string line;
+        while (std::getline(network_file, line)) {
+            networks[b].push_back(line);
+        }
+        std::sort(networks[b].begin(), networks[b].end());
+    }
+    return networks[0] == networks[1];
+}
+
+int main(int argc, char* argv[]) {
+    SimulationConfig config;
+    std::vector<size_t> sizes = {1000, 10000, 100000};
+    size_t num_threads = 1;
+    std::vector<SampleOrder> orders = {SampleOrder::file};
+    size_t num_probes = 1000;
+    std::string work_dir = "/tmp";
+    size_t check_batch_size = 0; // compare grafting in batches of this size against one by one, 0 does not
+    size_t compact_interval = 0;
+    // Parse command-line arguments
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            sizes.clear();
+            std::stringstream size_list(argv[++i]);
+            std::string size;
+            while (std::getline(size_list, size, ',')) {
+                sizes.push_back(std::stoul(size));
+            }
+        } else if (arg == "--orders" && i + 1 < argc) {
+            orders.clear();
+            std::stringstream order_list(argv[++i]);
+            std::string order_name;
+            SampleOrder order;
+            while (std::getline(order_list, order_name, ',')) {
+                if (!parse_sample_order(order_name, order)) {
+                    std::cerr << "Error: Unknown order " << order_name << std::endl;
+                    return 1;
+                }
+                orders.push_back(order);
+            }
+        } else if (arg == "--segments" && i + 1 < argc) {
+            config.num_segments = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--mutation-rate" && i + 1 < argc) {
+            config.mutation_rate = std::stod(argv[++i]);
+        } else if (arg == "--reassortment-rate" && i + 1 < argc) {
+            config.reassortment_rate = std::stod(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            config.seed = std::stoull(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--probes" && i + 1 < argc) {
+            num_probes = std::stoul(argv[++i]);
+        } else if (arg == "--dir" && i + 1 < argc) {
+            work_dir = argv[++i];
+        } else if (arg == "--check-batch" && i + 1 < argc) {
+            check_batch_size = std::stoul(argv[++i]);
+        } else if (arg == "--compact" && i + 1 < argc) {
+            compact_interval = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Usage: bench [--sizes N,N,...] [--orders file,date,mutations,nearest] [--segments N] [--mutation-rate R] [--reassortment-rate R] [--seed N] [--threads N] [--probes N] [--dir <directory>] [--check-batch K] [--compact N]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "segments=" << config.num_segments << " mutation_rate=" << config.mutation_rate
+              << " reassortment_rate=" << config.reassortment_rate << " seed=" << config.seed
+              << " threads=" << num_threads << " compact=" << compact_interval << std::endl;
+    std::printf("%10s %10s %10s %10s %9s %9s %9s %10s %9s %9s %9s %12s %11s %10s %13s\n",
+                "samples", "order", "nodes", "rejected", "parse_s", "order_s", "graft_s", "search_us", "write_s", "save_s", "load_s", "samples/s", "peak_rss_mb", "graft_exp", "allocs/sample");
+
+    std::vector<BenchResult> previous(orders.size()); // per order
+    for (size_t num_samples: sizes) {
+        std::string csv_filename = work_dir + "/entwine_bench_" + std::to_string(num_samples) + ".csv";
+        std::string network_filename = work_dir + "/entwine_bench_" + std::to_string(num_samples) + ".txt";
+        std::string snapshot_filename = work_dir + "/entwine_bench_" + std::to_string(num_samples) + ".snap";
+        std::string result_filename = work_dir + "/entwine_bench_" + std::to_string(num_samples) + ".result";
+        config.num_samples = num_samples;
+
+        int generate_status = run_in_child([&]() {
+            std::ofstream csv_file(csv_filename);
+            ReassortmentSimulator(config).write_csv(csv_file);
+            return csv_file ? 0 : 1;
+        });
+        for (size_t o = 0; o < orders.size(); o++) {
+            int status = generate_status;
+            if (status == 0) {
+                status = run_in_child([&]() {
+                    BenchResult result = bench_network(csv_filename, network_filename, snapshot_filename, orders[o], num_threads, num_probes, compact_interval);
+                    std::ofstream result_file(result_filename, std::ios::binary);
+                    result_file.write(reinterpret_cast<const char*>(&result), sizeof(result));
+                    return result_file ? 0 : 1;
+                });
+            }
+            BenchResult result;
+            std::ifstream result_file(result_filename, std::ios::binary);
+            if (status != 0 || !result_file.read(reinterpret_cast<char*>(&result), sizeof(result))) {
+                std::printf("%10zu %10s failed with exit status %d\n", num_samples, sample_order_name(orders[o]), status);
+            } else {
+                // Growth of graft time relative to the previous size: 1 is linear, 2 is quadratic
+                std::string graft_exp = "-";
+                if (previous[o].num_samples > 0 && previous[o].graft_seconds > 0 && result.num_samples != previous[o].num_samples) {
+                    char exponent[32];
+                    std::snprintf(exponent, sizeof(exponent), "%.2f", std::log(result.graft_seconds / previous[o].graft_seconds) / std::log(double(result.num_samples) / previous[o].num_samples));
+                    graft_exp = exponent;
+                }
+                std::printf("%10zu %10s %10zu %10zu %9.3f %9.3f %9.3f %10.2f %9.3f %9.3f %9.3f %12.0f %11.1f %10s %13.1f\n",
+                            result.num_samples, sample_order_name(orders[o]), result.num_nodes, result.parent_child_rejections, result.parse_seconds, result.order_seconds,
+                            result.graft_seconds, result.search_micros, result.write_seconds, result.snapshot_save_seconds, result.snapshot_load_seconds,
+                            result.num_samples / result.graft_seconds, result.peak_rss_kb / 1024.0, graft_exp.c_str(), result.graft_allocations);
+                previous[o] = result;
+            }
+            if (status == 0 && check_batch_size > 1) {
+                int check_status = run_in_child([&]() {
+                    return batch_matches_sequential(csv_filename, network_filename, orders[o], num_threads, check_batch_size, compact_interval) ? 0 : 2;
+                });
+                std::printf("%10zu %10s batch %zu compact %zu: %s\n", num_samples, sample_order_name(orders[o]), check_batch_size, compact_interval,
+                            check_status == 0 ? "same as one by one" : check_status == 2 ? "DIFFERS from one by one" : "failed");
+            }
+            std::fflush(stdout);
+            std::remove(network_filename.c_str());
+            std::remove(snapshot_filename.c_str());
+            std::remove(result_filename.c_str());
+        }
+        std::remove(csv_filename.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "ReassortmentSimulator.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    SimulationConfig config;
+    std::string output_filename = "";
+    // Parse command-line arguments
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            config.num_samples = std::stoul(argv[++i]);
+        } else if (arg == "--segments" && i + 1 < argc) {
+            config.num_segments = std::max(1ul, std::stoul(argv[++i]));
+        } else if (arg == "--mutation-rate" && i + 1 < argc) {
+            config.mutation_rate = std::stod(argv[++i]);
+        } else if (arg == "--reassortment-rate" && i + 1 < argc) {
+            config.reassortment_rate = std::stod(argv[++i]);
+        } else if (arg == "--samples-per-day" && i + 1 < argc) {
+            config.samples_per_day = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            config.seed = std::stoull(argv[++i]);
+        } else if (arg == "--output" && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else {
+            std::cerr << "Usage: generate [--samples N] [--segments N] [--mutation-rate R] [--reassortment-rate R] [--samples-per-day N] [--seed N] [--output <filename.csv>]" << std::endl;
+            return 1;
+        }
+    }
+
+    ReassortmentSimulator simulator(config);
+    if (output_filename.empty()) {
+        simulator.write_csv(std::cout);
+        return 0;
+    }
+    std::ofstream out_file(output_filename);
+    if (!out_file) {
+        std::cerr << "Error: Unable to open file " << output_filename << " for writing." << std::endl;
+        return 1;
+    }
+    simulator.write_csv(out_file);
+    return 0;
+}
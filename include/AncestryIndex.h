@@ -0,0 +1,170 @@
+#ifndef ANCESTRY_INDEX_H
+#define ANCESTRY_INDEX_H
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "NodeArena.h"
+
+using namespace std;
+
+// Ancestry of the nodes of a forest that changes as branches are added and removed: whether one node
+// is an ancestor of another, the depth of a node and the lowest common ancestor of two nodes, each in
+// O(log n) amortized time however deep the trees get. It is a link-cut tree: every tree is split into
+// paths, each kept as a splay tree ordered by depth, and a query first makes the path from root to
+// the node asked about one of them. Queries therefore rearrange the splay trees too, so all operations
+// take a lock and the index can be queried from several threads at once.
+class AncestryIndex {
+private:
+    struct Link {
+        node_id child[2] = {NO_NODE, NO_NODE}; // splay tree children: shallower, deeper
+        node_id parent = NO_NODE; // splay tree parent, or for the top of a splay tree the parent of its shallowest node
+        uint32_t size = 1; // nodes in this splay subtree
+    };
+
+    mutable vector<Link> links; // by node_id
+    mutable mutex lock;
+
+    uint32_t size(node_id id) const { return id == NO_NODE ? 0 : links[id].size; }
+
+    void update(node_id id) const {
+        links[id].size = 1 + size(links[id].child[0]) + size(links[id].child[1]);
+    }
+
+    // Whether id is the top of its splay tree, whose parent link leads to another path
+    bool is_top(node_id id) const {
+        node_id parent = links[id].parent;
+        return parent == NO_NODE || (links[parent].child[0] != id && links[parent].child[1] != id);
+    }
+
+    void rotate(node_id id) const {
+        node_id parent = links[id].parent;
+        node_id grandparent = links[parent].parent;
+        int side = links[parent].child[1] == id;
+        if (!is_top(parent)) {
+            links[grandparent].child[links[grandparent].child[1] == parent] = id;
+        }
+        links[id].parent = grandparent;
+        links[parent].child[side] = links[id].child[!side];
+        if (links[id].child[!side] != NO_NODE) {
+            links[links[id].child[!side]].parent = parent;
+        }
+        links[id].child[!side] = parent;
+        links[parent].parent = id;
+        update(parent);
+        update(id);
+    }
+
+    void splay(node_id id) const {
+        while (!is_top(id)) {
+            node_id parent = links[id].parent;
+            if (!is_top(parent)) {
+                bool zig_zig = (links[parent].child[1] == id) == (links[links[parent].parent].child[1] == parent);
+                rotate(zig_zig ? parent : id);
+            }
+            rotate(id);
+        }
+    }
+
+    // Makes the path from the root of its tree down to id one splay tree, topped by id. Returns the
+    // last node at which the walk joined a path, which is the lowest common ancestor of id and the
+    // node accessed before it.
+    node_id access(node_id id) const {
+        node_id last = NO_NODE;
+        for (node_id above = id; above != NO_NODE; above = links[above].parent) {
+            splay(above);
+            links[above].child[1] = last;
+            update(above);
+            last = above;
+        }
+        splay(id);
+        return last;
+    }
+
+    node_id find_root(node_id id) const {
+        access(id);
+        while (links[id].child[0] != NO_NODE) {
+            id = links[id].child[0];
+        }
+        splay(id);
+        return id;
+    }
+
+    void cut_locked(node_id id) {
+        access(id);
+        node_id above = links[id].child[0];
+        if (above != NO_NODE) {
+            links[above].parent = NO_NODE;
+            links[id].child[0] = NO_NODE;
+            update(id);
+        }
+    }
+
+    void reserve(node_id id) {
+        if (id >= links.size()) {
+            links.resize(max<size_t>(2 * links.size(), id + 1));
+        }
+    }
+
+public:
+    void clear() {
+        lock_guard<mutex> guard(lock);
+        links.clear();
+    }
+
+    // Makes parent the parent of child, which is moved from its current parent if it has one
+    void link(node_id child, node_id parent) {
+        lock_guard<mutex> guard(lock);
+        reserve(max(child, parent));
+        cut_locked(child);
+        links[child].parent = parent; // child tops its splay tree and has no shallower nodes once cut
+    }
+
+    // Detaches child, and the subtree below it, from its parent
+    void cut(node_id child) {
+        lock_guard<mutex> guard(lock);
+        if (child < links.size()) {
+            cut_locked(child);
+        }
+    }
+
+    // Detaches id from its parent and forgets it, so its slot can be reused; its children must have been moved
+    void remove(node_id id) {
+        lock_guard<mutex> guard(lock);
+        if (id < links.size()) {
+            cut_locked(id);
+            links[id] = Link();
+        }
+    }
+
+    // Lowest common ancestor of a and b, or NO_NODE if they are in different trees
+    node_id lca(node_id a, node_id b) const {
+        lock_guard<mutex> guard(lock);
+        if (a >= links.size() || b >= links.size()) {
+            return a == b ? a : NO_NODE;
+        }
+        if (find_root(a) != find_root(b)) {
+            return NO_NODE;
+        }
+        access(a);
+        return access(b);
+    }
+
+    // Whether ancestor is on the path from the root of its tree to id, id itself included
+    bool is_ancestor(node_id ancestor, node_id id) const {
+        return lca(ancestor, id) == ancestor;
+    }
+
+    // Edges between id and the root of its tree
+    size_t depth(node_id id) const {
+        lock_guard<mutex> guard(lock);
+        if (id >= links.size()) {
+            return 0;
+        }
+        access(id);
+        return size(links[id].child[0]);
+    }
+};
+
+#endif // ANCESTRY_INDEX_H
@@ -0,0 +1,57 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+
+using namespace std;
+
+// Queue between two stages of a pipeline. push blocks while the queue holds capacity items,
+// so a fast producer cannot run ahead of the consumer by more than capacity items.
+template <typename T>
+class BoundedQueue {
+private:
+    queue<T> items;
+    size_t capacity;
+    bool closed = false;
+    mutex items_mutex;
+    condition_variable not_empty;
+    condition_variable not_full;
+
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(max<size_t>(1, capacity)) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    void push(T item) {
+        unique_lock<mutex> lock(items_mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+        items.push(move(item));
+        not_empty.notify_one();
+    }
+
+    // Called by the producer once it has pushed its last item
+    void close() {
+        lock_guard<mutex> lock(items_mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+    // Takes the next item, waiting for one if necessary; returns false once the queue is closed and empty
+    bool pop(T& item) {
+        unique_lock<mutex> lock(items_mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = move(items.front());
+        items.pop();
+        not_full.notify_one();
+        return true;
+    }
+};
+
+#endif // BOUNDED_QUEUE_H
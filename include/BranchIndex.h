@@ -0,0 +1,62 @@
+#ifndef BRANCH_INDEX_H
+#define BRANCH_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "MutationSet.h"
+#include "NodeArena.h"
+
+using namespace std;
+
+// Nodes with at least this many children keep a BranchIndex over their child branches
+const size_t BRANCH_INDEX_MIN_CHILDREN = 32;
+
+// Inverted index from (segment, mutation) to the children of one node whose incoming
+// branch carries that mutation. Kept in step with branch_mutations by
+// Network::add_branch and Network::remove_branch, it lets the graft search find the
+// children of a wide node that share mutations with a sample without scanning every
+// child branch.
+class BranchIndex {
+private:
+    unordered_map<uint64_t, vector<node_id>> children_with_mut;
+
+    static uint64_t key(size_t seg, mut_id mut) {
+        return (static_cast<uint64_t>(seg) << 32) | mut;
+    }
+
+public:
+    void add(node_id child, size_t seg, const mut_set& muts) {
+        for (mut_id mut: muts) {
+            children_with_mut[key(seg, mut)].push_back(child);
+        }
+    }
+
+    void remove(node_id child, size_t seg, const mut_set& muts) {
+        for (mut_id mut: muts) {
+            auto it = children_with_mut.find(key(seg, mut));
+            if (it == children_with_mut.end()) {
+                continue;
+            }
+            vector<node_id>& carriers = it->second;
+            auto carrier = find(carriers.begin(), carriers.end(), child);
+            if (carrier != carriers.end()) {
+                *carrier = carriers.back();
+                carriers.pop_back();
+            }
+            if (carriers.empty()) {
+                children_with_mut.erase(it);
+            }
+        }
+    }
+
+    // Children whose branch carries mut on segment seg, or nullptr if there are none
+    const vector<node_id> * children_with(size_t seg, mut_id mut) const {
+        auto it = children_with_mut.find(key(seg, mut));
+        return it == children_with_mut.end() ? nullptr : &it->second;
+    }
+};
+
+#endif // BRANCH_INDEX_H
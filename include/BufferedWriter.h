@@ -0,0 +1,87 @@
+#ifndef BUFFERED_WRITER_H
+#define BUFFERED_WRITER_H
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+using namespace std;
+
+// Output file that collects text in a large buffer and hands it to the kernel with one
+// write per BUFFER_SIZE bytes. It streams like an ostream for strings, characters and
+// integers, which is all the network writers need, without the per-insertion overhead.
+class BufferedWriter {
+private:
+    int fd = -1;
+    string buffer;
+    bool failed = false;
+
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    void write_out() {
+        size_t written = 0;
+        while (!failed && written < buffer.size()) {
+            ssize_t num_written = ::write(fd, buffer.data() + written, buffer.size() - written);
+            if (num_written < 0 && errno != EINTR) {
+                failed = true;
+            } else if (num_written > 0) {
+                written += num_written;
+            }
+        }
+        buffer.clear();
+    }
+
+public:
+    BufferedWriter() { buffer.reserve(BUFFER_SIZE + 4096); }
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    ~BufferedWriter() { close(); }
+
+    bool open(const string& file_name) {
+        fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        return fd >= 0;
+    }
+
+    // Flushes and closes the file; returns false if anything could not be written
+    bool close() {
+        if (fd >= 0) {
+            write_out();
+            failed |= ::close(fd) != 0;
+            fd = -1;
+        }
+        return !failed;
+    }
+
+    BufferedWriter& operator<<(string_view str) {
+        buffer.append(str.data(), str.size());
+        if (buffer.size() >= BUFFER_SIZE) {
+            write_out();
+        }
+        return *this;
+    }
+
+    BufferedWriter& operator<<(const string& str) { return *this << string_view(str); }
+    BufferedWriter& operator<<(const char * str) { return *this << string_view(str); }
+
+    BufferedWriter& operator<<(char c) {
+        buffer.push_back(c);
+        if (buffer.size() >= BUFFER_SIZE) {
+            write_out();
+        }
+        return *this;
+    }
+
+    template <typename Integer, typename = enable_if_t<is_integral_v<Integer>>>
+    BufferedWriter& operator<<(Integer value) {
+        char digits[24];
+        return *this << string_view(digits, to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+    }
+};
+
+#endif // BUFFERED_WRITER_H
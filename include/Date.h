@@ -0,0 +1,87 @@
+#ifndef DATE_H
+#define DATE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Dates are compared as whole days since 1970-01-01 (negative before)
+typedef int32_t day_t;
+
+const day_t NO_DAY = numeric_limits<day_t>::max(); // no date, later than every date
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+inline day_t days_from_civil(int year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    unsigned year_of_era = static_cast<unsigned>(year - era * 400);
+    unsigned day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + static_cast<int>(day_of_era) - 719468;
+}
+
+inline bool is_leap_year(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+inline unsigned days_in_month(int year, unsigned month) {
+    static const unsigned DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return month == 2 && is_leap_year(year) ? 29 : DAYS[month - 1];
+}
+
+// Parses an ISO date, YYYY-MM-DD, or a partial one, YYYY-MM or YYYY, which stands for its first day, or its
+// last day if latest is set. Returns NO_DAY for anything else, including empty and out-of-range dates.
+inline day_t parse_day(string_view date, bool latest = false) {
+    auto number = [&](size_t first, size_t length, int& value) {
+        if (first + length > date.size()) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = first; i < first + length; i++) {
+            if (date[i] < '0' || date[i] > '9') {
+                return false;
+            }
+            value = value * 10 + (date[i] - '0');
+        }
+        return true;
+    };
+    int year, month = latest ? 12 : 1, day = 1;
+    if (!number(0, 4, year) || (date.size() != 4 && date.size() != 7 && date.size() != 10)) {
+        return NO_DAY;
+    }
+    if (date.size() >= 7 && (date[4] != '-' || !number(5, 2, month) || month < 1 || month > 12)) {
+        return NO_DAY;
+    }
+    if (latest) {
+        day = days_in_month(year, month);
+    }
+    if (date.size() == 10 && (date[7] != '-' || !number(8, 2, day) || day < 1 || day > static_cast<int>(days_in_month(year, month)))) {
+        return NO_DAY;
+    }
+    return days_from_civil(year, month, day);
+}
+
+// YYYY-MM-DD of a day returned by parse_day, or an empty string for NO_DAY
+inline string format_day(day_t day) {
+    if (day == NO_DAY) {
+        return "";
+    }
+    int days = day + 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned day_of_era = static_cast<unsigned>(days - era * 146097);
+    unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    unsigned month_index = (5 * day_of_year + 2) / 153;
+    unsigned day_of_month = day_of_year - (153 * month_index + 2) / 5 + 1;
+    unsigned month = month_index < 10 ? month_index + 3 : month_index - 9;
+    int year = static_cast<int>(year_of_era) + era * 400 + (month <= 2);
+    char formatted[32];
+    snprintf(formatted, sizeof(formatted), "%04d-%02u-%02u", year, month, day_of_month);
+    return formatted;
+}
+
+#endif // DATE_H
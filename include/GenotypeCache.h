@@ -0,0 +1,103 @@
+#ifndef GENOTYPE_CACHE_H
+#define GENOTYPE_CACHE_H
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MutationSet.h"
+#include "NodeArena.h"
+
+using namespace std;
+
+// Mutation IDs held by the genotype cache of a network (about 16MB with the entries)
+const size_t GENOTYPE_CACHE_MUTS = 1 << 21;
+// Of the nodes on a path walked to root, every this-many-th one is cached
+const size_t GENOTYPE_CACHE_STRIDE = 8;
+
+// Least recently used cache of mutation sets reconstructed per (node, segment). It holds at most
+// max_muts mutation IDs in total, counting ENTRY_COST more for the bookkeeping of each set, so its
+// memory stays bounded however many nodes are looked up; the least recently used sets are dropped
+// to make room for new ones. A bit per (node, segment) answers lookups that miss, which are most
+// of them, without hashing.
+class GenotypeCache {
+private:
+    typedef pair<size_t, mut_set> Entry;
+
+    size_t num_segs = 0;
+    size_t max_muts = 0;
+    size_t num_muts = 0; // mutation IDs held, plus ENTRY_COST per set
+    list<Entry> entries; // most recently used first
+    unordered_map<size_t, list<Entry>::iterator> positions;
+    vector<bool> cached; // by key
+
+    static const size_t ENTRY_COST = 32; // list and hash map nodes of an entry, in mutation IDs
+
+    static size_t cost(const mut_set& muts) { return muts.size() + ENTRY_COST; }
+
+    size_t key(node_id node, size_t seg) const { return size_t(node) * num_segs + seg; }
+
+    bool contains(size_t k) const { return k < cached.size() && cached[k]; }
+
+    void drop(list<Entry>::iterator entry) {
+        num_muts -= cost(entry->second);
+        cached[entry->first] = false;
+        positions.erase(entry->first);
+        entries.erase(entry);
+    }
+
+public:
+    // Empties the cache and sizes it for a network with num_segs segments
+    void reset(size_t num_segs_to_set, size_t max_muts_to_set) {
+        num_segs = num_segs_to_set;
+        max_muts = max_muts_to_set;
+        num_muts = 0;
+        entries.clear();
+        positions.clear();
+        cached.clear();
+    }
+
+    // The cached set of node for seg, or nullptr; a hit becomes the most recently used entry
+    const mut_set * find(node_id node, size_t seg) {
+        size_t k = key(node, seg);
+        if (!contains(k)) {
+            return nullptr;
+        }
+        auto entry = positions.find(k)->second;
+        entries.splice(entries.begin(), entries, entry);
+        return &entry->second;
+    }
+
+    void insert(node_id node, size_t seg, const mut_set& muts) {
+        size_t k = key(node, seg);
+        if (contains(k)) {
+            drop(positions.find(k)->second);
+        }
+        if (cost(muts) > max_muts) {
+            return;
+        }
+        while (num_muts + cost(muts) > max_muts && !entries.empty()) {
+            drop(prev(entries.end()));
+        }
+        if (k >= cached.size()) {
+            cached.resize(2 * k + num_segs, false);
+        }
+        entries.emplace_front(k, muts);
+        positions[k] = entries.begin();
+        cached[k] = true;
+        num_muts += cost(muts);
+    }
+
+    // Drops the sets of node, whose slot is about to be reused
+    void erase(node_id node) {
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            size_t k = key(node, seg);
+            if (contains(k)) {
+                drop(positions.find(k)->second);
+            }
+        }
+    }
+};
+
+#endif // GENOTYPE_CACHE_H
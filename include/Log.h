@@ -0,0 +1,35 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <iostream>
+
+using namespace std;
+
+// Console message levels. Errors are not logged through these, they always go to cerr.
+enum LogLevel {
+    LOG_QUIET = 0,   // nothing but errors
+    LOG_INFO = 1,    // segments and mutation totals
+    LOG_VERBOSE = 2, // one line per grafted sample and the whole network at the end
+    LOG_DEBUG = 3    // per-segment graft details
+};
+
+// Messages above this level are compiled out, e.g. -DENTWINE_MAX_LOG_LEVEL=1 removes all per-sample output
+#ifndef ENTWINE_MAX_LOG_LEVEL
+#define ENTWINE_MAX_LOG_LEVEL LOG_DEBUG
+#endif
+
+// Level of messages printed at run time (--log-level)
+inline int log_level = LOG_INFO;
+
+#define ENTWINE_LOG_ENABLED(level) ((level) <= ENTWINE_MAX_LOG_LEVEL && (level) <= log_level)
+
+// Streams message to cout, e.g. ENTWINE_LOG(LOG_DEBUG, "Graft node is " << name << endl);
+// the message is not evaluated unless the level is enabled
+#define ENTWINE_LOG(level, message) \
+    do { \
+        if (ENTWINE_LOG_ENABLED(level)) { \
+            cout << message; \
+        } \
+    } while (0)
+
+#endif // LOG_H
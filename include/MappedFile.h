@@ -0,0 +1,67 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Read-only view of a whole file. Regular files are memory-mapped; anything that
+// cannot be mapped (pipes, character devices) is read into memory instead.
+class MappedFile {
+private:
+    const char * mapped = nullptr;
+    size_t mapped_size = 0;
+    string buffer;
+    string_view contents;
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (mapped != nullptr) {
+            munmap(const_cast<char*>(mapped), mapped_size);
+        }
+    }
+
+    bool open(const string& file_name) {
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+            void * addr = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, file_stat.st_size, MADV_SEQUENTIAL);
+                mapped = static_cast<const char*>(addr);
+                mapped_size = file_stat.st_size;
+                contents = string_view(mapped, mapped_size);
+                ::close(fd);
+                return true;
+            }
+        }
+        char read_buffer[1 << 16];
+        ssize_t num_read;
+        while ((num_read = ::read(fd, read_buffer, sizeof(read_buffer))) > 0) {
+            buffer.append(read_buffer, num_read);
+        }
+        ::close(fd);
+        if (num_read < 0) {
+            return false;
+        }
+        contents = string_view(buffer);
+        return true;
+    }
+
+    string_view view() const { return contents; }
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,69 @@
+#ifndef MUTATION_DICTIONARY_H
+#define MUTATION_DICTIONARY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "MutationSet.h"
+
+using namespace std;
+
+// Interns mutation strings into dense integer IDs. Every distinct mutation string
+// is stored exactly once; nodes refer to mutations only through their IDs.
+class MutationDictionary {
+private:
+    deque<string> names; // deque keeps string addresses stable for the views in ids
+    unordered_map<string_view, mut_id> ids;
+
+public:
+    MutationDictionary() = default;
+    MutationDictionary(const MutationDictionary&) = delete;
+    MutationDictionary& operator=(const MutationDictionary&) = delete;
+    MutationDictionary(MutationDictionary&&) = default;
+    MutationDictionary& operator=(MutationDictionary&&) = default;
+
+    // Returns the ID of mutation, assigning the next free ID if it is new
+    mut_id intern(string_view mutation) {
+        auto it = ids.find(mutation);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        mut_id id = static_cast<mut_id>(names.size());
+        names.emplace_back(mutation);
+        ids.emplace(string_view(names.back()), id);
+        return id;
+    }
+
+    // Returns the ID of mutation or NO_MUTATION if it has never been interned
+    mut_id find(string_view mutation) const {
+        auto it = ids.find(mutation);
+        return it == ids.end() ? NO_MUTATION : it->second;
+    }
+
+    const string& name(mut_id id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+    // Writes the names of muts as a separator-separated list in lexicographic order to an ostream or BufferedWriter.
+    // IDs from size() on are named by query_names, in order: mutations of a query that the dictionary does not hold.
+    template <typename Out>
+    void write_names(Out& out, const mut_set& muts, const char * separator = ", ", const vector<string>& query_names = {}) const {
+        vector<const string*> sorted_names;
+        sorted_names.reserve(muts.size());
+        for (mut_id mut: muts) {
+            sorted_names.push_back(mut < names.size() ? &names[mut] : &query_names[mut - names.size()]);
+        }
+        sort(sorted_names.begin(), sorted_names.end(), [](const string* a, const string* b) { return *a < *b; });
+        for (size_t i = 0; i < sorted_names.size(); i++) {
+            if (i > 0) out << separator;
+            out << *sorted_names[i];
+        }
+    }
+};
+
+#endif // MUTATION_DICTIONARY_H
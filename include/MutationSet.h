@@ -0,0 +1,103 @@
+#ifndef MUTATION_SET_H
+#define MUTATION_SET_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+// Mutations are interned into dense IDs (see MutationDictionary.h) and sets of
+// mutations are kept as sorted, duplicate-free arrays of IDs so that every set
+// operation on the graft path is a linear merge over integers.
+typedef uint32_t mut_id;
+typedef vector<mut_id> mut_set;
+
+const mut_id NO_MUTATION = numeric_limits<mut_id>::max();
+
+// Sorts ids and drops duplicates so that they form a valid mut_set
+inline void normalize_mut_set(mut_set& ids) {
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+}
+
+inline bool contains_mut(const mut_set& muts, mut_id mut) {
+    return binary_search(muts.begin(), muts.end(), mut);
+}
+
+// |a ∩ b|
+inline size_t count_common_muts(const mut_set& a, const mut_set& b) {
+    size_t count = 0;
+    auto it_a = a.begin();
+    auto it_b = b.begin();
+    while (it_a != a.end() && it_b != b.end()) {
+        if (*it_a < *it_b) {
+            ++it_a;
+        } else if (*it_b < *it_a) {
+            ++it_b;
+        } else {
+            ++count;
+            ++it_a;
+            ++it_b;
+        }
+    }
+    return count;
+}
+
+// Splits muts into the mutations that are in filter (in_filter) and those that are not (not_in_filter)
+inline void split_muts(const mut_set& muts, const mut_set& filter, mut_set& in_filter, mut_set& not_in_filter) {
+    in_filter.clear();
+    not_in_filter.clear();
+    auto it_f = filter.begin();
+    for (mut_id mut: muts) {
+        while (it_f != filter.end() && *it_f < mut) {
+            ++it_f;
+        }
+        if (it_f != filter.end() && *it_f == mut) {
+            in_filter.push_back(mut);
+        } else {
+            not_in_filter.push_back(mut);
+        }
+    }
+}
+
+// a = a \ b
+inline void subtract_muts(mut_set& a, const mut_set& b) {
+    if (b.empty()) {
+        return;
+    }
+    auto it_b = b.begin();
+    auto out = a.begin();
+    for (auto it_a = a.begin(); it_a != a.end(); ++it_a) {
+        while (it_b != b.end() && *it_b < *it_a) {
+            ++it_b;
+        }
+        if (it_b == b.end() || *it_b != *it_a) {
+            *out++ = *it_a;
+        }
+    }
+    a.erase(out, a.end());
+}
+
+// a = a ∪ b, merged in place from the back so that a only allocates when it outgrows its capacity
+inline void unite_muts(mut_set& a, const mut_set& b) {
+    if (b.empty()) {
+        return;
+    }
+    size_t a_size = a.size();
+    a.resize(a_size + b.size() - count_common_muts(a, b));
+    size_t i = a_size, j = b.size(), out = a.size();
+    while (j > 0) {
+        if (i > 0 && a[i - 1] > b[j - 1]) {
+            a[--out] = a[--i];
+        } else {
+            if (i > 0 && a[i - 1] == b[j - 1]) {
+                --i;
+            }
+            a[--out] = b[--j];
+        }
+    }
+}
+
+#endif // MUTATION_SET_H
@@ -2,101 +2,153 @@
 #define NETWORK_H
 
 #include <iostream>
-#include <map>
 #include <memory>
-#include <set>
 #include <tuple>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <fstream>
 #include <sstream>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
-using namespace std;
-
-// Helper function to trim whitespace from a string
-inline string trim(const string& str) {
-    size_t first = str.find_first_not_of(" \t\n\r");
-    size_t last = str.find_last_not_of(" \t\n\r");
-    return (first == string::npos || last == string::npos) ? "" : str.substr(first, last - first + 1);
-}
+#include "AncestryIndex.h"
+#include "BranchIndex.h"
+#include "BufferedWriter.h"
+#include "Date.h"
+#include "GenotypeCache.h"
+#include "Log.h"
+#include "MutationBitset.h"
+#include "MutationDictionary.h"
+#include "MutationSet.h"
+#include "NetworkStats.h"
+#include "NodeArena.h"
+#include "BoundedQueue.h"
+#include "SampleOrder.h"
+#include "SampleStream.h"
+#include "SampleTable.h"
+#include "Snapshot.h"
+#include "SubtreeSummary.h"
+#include "ThreadPool.h"
 
+using namespace std;
 
 // Node Class
 class Node {
     public:
 
+    node_id id = NO_NODE; // handle of this node in Network::nodes
     int in_degree = 0;
     int out_degree = 0;
     string name;
     string date;
-    map<string, set<string>> sample_mutations; // Sample Mutations W.R.T Root Genome For Each Segment    
-    map<string, set<string>> branch_mutations; // Branch Mutations For Each Segment
-    Node * parent; // <-> This is usable for Non-Reassortment nodes where each segment has same parent
-    vector<Node*> children;
-    map<string,Node *> parent4seg; // <-> This is usable for Reassortment nodes where segments have different parents
+    day_t day = NO_DAY; // date parsed once; NO_DAY for hidden, reassortment and root nodes, whose dates are inferred, and for unparsable dates
+    day_t subtree_min_day = NO_DAY; // earliest day of this node and the nodes below it, the inferred date of nodes without one
+    vector<mut_set> sample_mutations; // Sample Mutations W.R.T Root Genome, indexed by segment
+    vector<mut_set> branch_mutations; // Branch Mutations, indexed by segment
+    node_id parent = NO_NODE; // <-> This is usable for Non-Reassortment nodes where each segment has same parent
+    vector<node_id> children;
+    vector<node_id> parent4seg; // <-> This is usable for Reassortment nodes where segments have different parents, indexed by segment
     bool reassortment_node = false;
-    // Constructor
-    Node(const string& node_name, const string& node_date,
-         const map<string, set<string>>& node_mutations)
-        : name(node_name), date(node_date), sample_mutations(node_mutations) {}
+    bool hidden_node = false; // added by a graft to split a branch, may be removed by Network::compact
+    bool implicit_genotype = false; // sample_mutations released, see Network::release_genotype
+    vector<mut_id> genotype_delta; // implicit genotype: how it differs from the path mutations, see Network::release_genotype; empty if it does not
+    size_t child_index = 0; // position in children of parent
+    vector<int> last_empty_child; // per segment, position in children of the last child whose branch has no mutations for the segment (-1 if none)
+    unique_ptr<BranchIndex> branch_index; // index over child branches, built once the node has BRANCH_INDEX_MIN_CHILDREN children
+    SubtreeSummary subtree_summary; // mutations on the branches below this node
+    // Constructors
+    Node() = default;
+    Node(string node_name, string node_date, vector<mut_set> node_mutations)
+        : name(move(node_name)), date(move(node_date)), day(parse_day(date)), subtree_min_day(day), sample_mutations(move(node_mutations)), branch_mutations(sample_mutations.size()) {}
 
     // Getters
-    string get_name() const { return name; }
-    string getDate() const { return date; }
-    map<string, set<string>> getSampleMutations() const { return sample_mutations; }
-    map<string, set<string>> getBranchMutations() const { return branch_mutations; }
+    const string& get_name() const { return name; }
+    const string& getDate() const { return date; }
+    const vector<mut_set>& getSampleMutations() const { return sample_mutations; }
+    const vector<mut_set>& getBranchMutations() const { return branch_mutations; }
 
     // Setters
-    void set_branch_mutations(map<string, set<string>> & branch_mutations_to_set) {
-        branch_mutations = branch_mutations_to_set;
+    void set_branch_mutations(vector<mut_set> branch_mutations_to_set) {
+        branch_mutations = move(branch_mutations_to_set);
     }
 
-    void set_parent(Node* parent_to_set) {
+    void set_parent(node_id parent_to_set) {
         parent = parent_to_set;
         in_degree++;
     }
 
-    void setParentForSegment(string seg_name, Node * parent_to_set) {
-        parent4seg[seg_name] = parent_to_set;
+    void setParentForSegment(size_t seg, node_id parent_to_set) {
+        if (parent4seg.empty()) {
+            parent4seg.assign(branch_mutations.size(), NO_NODE);
+        }
+        parent4seg[seg] = parent_to_set;
     }
 
     void remove_parent() {
-        parent = nullptr;
+        parent = NO_NODE;
         in_degree --;
-        branch_mutations.clear();
+        for (mut_set& muts: branch_mutations) {
+            muts.clear();
+        }
     }
 
-    void add_child(Node* child_to_add) {
+    void add_child(node_id child_to_add) {
         children.push_back(child_to_add);
         out_degree++;
+        if (last_empty_child.empty()) {
+            last_empty_child.assign(branch_mutations.size(), -1);
+        }
     }
 
-    void remove_child(Node* child_to_remove) {
-        children.push_back(child_to_remove);
-        vector<Node*>::iterator child_to_remove_iterator = remove(children.begin(),children.end(),child_to_remove);
-        if (child_to_remove_iterator != children.end()) {
-            children.erase(child_to_remove_iterator,children.end());
+    void remove_child(node_id child_to_remove) {
+        size_t num_children = children.size();
+        children.erase(remove(children.begin(), children.end(), child_to_remove), children.end());
+        out_degree -= static_cast<int>(num_children - children.size()); // nothing if it was not a child
+    }
+
+    // Records that the child at children[child_pos] has no branch mutations for the segments where branch_muts is empty
+    void note_empty_branch(size_t child_pos, const vector<mut_set>& branch_muts) {
+        for (size_t seg = 0; seg < branch_muts.size(); seg++) {
+            if (branch_muts[seg].empty()) {
+                last_empty_child[seg] = child_pos;
+            }
         }
-        out_degree--;        
     }
     
-    // Print node details
-    void print_node() const {
-        cout << "Name: " << name << ", Date: " << date << ", Mutations: ";
-        for (const auto& [segment, mut_set] : sample_mutations) {
-            cout << segment << ":[";
-            for (auto it = mut_set.begin(); it != mut_set.end(); ++it) {
-                cout << *it;
-                if (next(it) != mut_set.end()) cout << ", ";
-            }
+    // Print node details, with the sample mutations given by Network::sample_genotype
+    void print_node(const vector<string>& seg_names, const MutationDictionary& mutation_dict, const vector<mut_set>& genotype) const {
+        cout << "Name: " << name << ", Date: " << (date.empty() && subtree_min_day != NO_DAY ? format_day(subtree_min_day) + " (inferred)" : date) << ", Mutations: ";
+        for (size_t seg = 0; seg < genotype.size(); seg++) {
+            cout << seg_names[seg] << ":[";
+            mutation_dict.write_names(cout, genotype[seg]);
             cout << "] ";
         }
         cout << endl;
     }
 };
 
+// Where a sample attaches to the network, as found by Network::place_sample
+struct Placement {
+    vector <tuple<node_id, mut_set, mut_set>> graft_info; // per segment: graft node, sample mutations not on the path to it, conflicting mutations on that path
+    vector <pair<node_id, vector<size_t>>> reassortment_groups; // graft nodes in order of first segment grafted there
+    bool parent_child = false; // two groups whose graft nodes are parent and child; graft_sample adds no reassortment for these
+    bool ancestral = false; // two groups whose graft nodes are ancestor and descendant further apart, which do make a reassortment
+    bool search_failed = false; // a search passed the depth limit, see Network::allow_search_failures; nothing else is set
+
+    bool is_reassortment() const { return reassortment_groups.size() > 1 && !parent_child; }
+};
+
+// Nodes read by a graft search, so that a search made before other samples were grafted can be validated
+struct SearchTrace {
+    vector<node_id> path; // nodes whose children the search examined, from root to the graft node
+    bool exceeded_loop_limit = false;
+};
+
 // Network Class
 class Network {
 private:
@@ -104,20 +156,43 @@ private:
     int h_index = 1; // index of non-reassortment hidden node
     string mutations_file_name; 
     string network_file_name;   
-    vector<string> seg_names = {"PB1", "PB2", "PA", "HA", "NP", "NA", "M1", "NS1"};
-    map<string, unique_ptr<Node>> nodes; // Map of nodes
-    Node * root;
+    vector<string> seg_names = {"PB1", "PB2", "PA", "HA", "NP", "NA", "M1", "NS1"}; // replaced by the header of the mutations file, segments are referred to by their index in seg_names
+    SlabArena<Node> nodes; // Node storage, nodes refer to each other by node_id handles into nodes
+    unordered_map<string_view, node_id> node_ids; // Node name -> handle, keys view the name stored in the node; only used at I/O boundaries
+    MutationDictionary mutation_dict; // Mutation strings <-> mutation IDs used in mut_set
+    node_id root = NO_NODE;
+    unique_ptr<ThreadPool> thread_pool; // runs the per-segment graft searches
+    NetworkStats stats;
+    size_t batch_size = 1; // samples searched together by graft_batch, 1 grafts one sample at a time
+    uint32_t batch_epoch = 0;
+    vector<uint32_t> changed_in_batch; // per node, the last batch epoch in which a graft changed it
+    bool use_subtree_summaries = false; // keep Node::subtree_summary and skip nodes with no matching mutation below them
+    bool use_temporal_pruning = false; // skip children whose subtree is entirely newer than the sample
+    bool search_failures_allowed = false; // a search past the depth limit fails its sample instead of ending the process
+    bool record_lowered_days = false; // collect the nodes whose subtree_min_day falls in lowered_days, for graft_batch
+    vector<node_id> lowered_days;
+    size_t mut_id_bound = 0; // above every mutation ID in the network, so searches need not read mutation_dict while it grows
+    size_t compact_interval = 0; // samples grafted between compactions, 0 for none
+    size_t samples_at_compaction = 0; // stats.samples_grafted at the last compaction
+    SampleOrder sample_order = SampleOrder::file; // order in which read_mutations_from_file grafts samples
+    bool use_implicit_genotypes = false; // release sample_mutations once grafted and rebuild genotypes from the branches
+    mutable GenotypeCache genotype_cache; // path mutations of recently reconstructed nodes, per segment
+    unique_ptr<mutex> genotype_lock = make_unique<mutex>(); // held while genotype_cache is used, so genotypes can be rebuilt by concurrent readers
+    unique_ptr<AncestryIndex> ancestry; // ancestry along Node::parent (--ancestry-index), kept up to date by every change of parent; null if not enabled
         
 
 public:
     // Constructor
-    Network(string mutations_file_name, string network_file_name) : mutations_file_name(mutations_file_name), network_file_name(network_file_name) {
-        create_root(); // Replace with parser for root genome file
-        read_mutations_from_file();
-        write_network();
-        print_network();
+    Network(string mutations_file_name, string network_file_name, size_t num_threads = 1, size_t batch_size = 1)
+        : mutations_file_name(mutations_file_name), network_file_name(network_file_name), thread_pool(make_unique<ThreadPool>(num_threads)), batch_size(max<size_t>(1, batch_size)) {
+        read_mutations_from_file(mutations_file_name); // creates root once the segments are known from the header
+        write_network(network_file_name);
     }
 
+    // Empty network for callers that drive loading, grafting and writing themselves
+    explicit Network(size_t num_threads, size_t batch_size = 1)
+        : thread_pool(make_unique<ThreadPool>(num_threads)), batch_size(max<size_t>(1, batch_size)) {}
+
     // Disable copy constructor & copy assignment (to enforce unique ownership)
     Network(const Network&) = delete;
     Network& operator=(const Network&) = delete;
@@ -126,451 +201,1663 @@ public:
     Network(Network&&) = default;
     Network& operator=(Network&&) = default;
 
-    // Function to add a node
-    void add_node(const string& node_name, const string& date, const map<string, set<string>>& mutations) {
-        if (nodes.find(node_name) != nodes.end()) {
-            cerr << "Error: Node with name '" << node_name << "' already exists.\n";
+    const NetworkStats& get_stats() const { return stats; }
+    const vector<string>& get_seg_names() const { return seg_names; }
+    node_id get_root() const { return root; }
+    ThreadPool& get_thread_pool() const { return *thread_pool; }
+    MutationDictionary& get_mutation_dict() { return mutation_dict; }
+    const MutationDictionary& get_mutation_dict() const { return mutation_dict; }
+
+    // Writes the profile of this run as JSON (--stats)
+    void write_stats(const string& file_name) const {
+        ofstream out_file(file_name);
+        if (!out_file) {
+            cerr << "Error: Unable to open file " << file_name << " for writing.\n";
             return;
         }
-        nodes[node_name] = make_unique<Node>(node_name, date, mutations);
+        write_stats(out_file);
+    }
+
+    void write_stats(ostream& out) const {
+        stats.write_json(out, seg_names, nodes.size());
     }
 
-    void create_root() {
+    // Counts placements made with place_sample by callers other than place_samples_from_file
+    void add_placements(size_t num_samples, double seconds) {
+        stats.samples_placed += num_samples;
+        stats.place_seconds += seconds;
+    }
+
+    Node& node(node_id id) { return nodes[id]; }
+    const Node& node(node_id id) const { return nodes[id]; }
+
+    // Function to add a node (returns its handle or NO_NODE if the name is taken)
+    node_id add_node(string node_name, string date, vector<mut_set> mutations) {
+        if (node_ids.find(node_name) != node_ids.end()) {
+            cerr << "Error: Node with name '" << node_name << "' already exists.\n";
+            return NO_NODE;
+        }
+        node_id id = nodes.create(move(node_name), move(date), move(mutations));
+        nodes[id].id = id;
+        for (const mut_set& muts: nodes[id].sample_mutations) {
+            if (!muts.empty()) {
+                mut_id_bound = max<size_t>(mut_id_bound, muts.back() + 1);
+            }
+        }
+        node_ids.emplace(string_view(nodes[id].name), id);
+        return id;
+    }
+
+    void create_root() { // Replace with parser for root genome file
         string root_name = "Root";
-        string root_date = "1987-03-30"; // set using input data TMP_FLG
-        map<string, set<string>> root_muts;
-        for (string& seg_name: seg_names) {
-            root_muts[seg_name] = set<string>();
+        root = add_node(root_name, "", vector<mut_set>(seg_names.size())); // dated by its subtree, like hidden nodes
+    }
+
+    void add_branch(node_id parent_id, node_id child_id, vector<mut_set> branch_mutations) {
+        Node& parent = node(parent_id);
+        Node& child = node(child_id);
+        if (child.parent != NO_NODE) {
+            unindex_branch(child.parent, child_id); // reassortment nodes are added below the parent of every group and keep a single index entry
+        }
+        parent.add_child(child_id);
+        child.child_index = parent.children.size() - 1;
+        child.set_parent(parent_id);
+        if (ancestry) {
+            ancestry->link(child_id, parent_id);
+        }
+        child.set_branch_mutations(move(branch_mutations));
+        parent.note_empty_branch(child.child_index, child.branch_mutations);
+        if (parent.branch_index) {
+            index_branch(parent_id, child_id);
+        } else if (parent.children.size() >= BRANCH_INDEX_MIN_CHILDREN) {
+            build_branch_index(parent_id);
+        }
+        if (use_subtree_summaries) {
+            summarize_branch(parent_id, child_id);
+        }
+        lower_subtree_min_day(parent_id, child.subtree_min_day);
+    }
+
+    // Sets subtree_min_day of every node from the days of the nodes below it. Dated nodes are taken earliest
+    // first, so the walk up from each stops at the first node that an earlier one already reached.
+    void build_subtree_min_days() {
+        vector<node_id> dated;
+        for (node_id id = 0; id < nodes.capacity(); id++) {
+            if (nodes.is_live(id)) {
+                node(id).subtree_min_day = NO_DAY;
+                if (node(id).day != NO_DAY) {
+                    dated.push_back(id);
+                }
+            }
+        }
+        stable_sort(dated.begin(), dated.end(), [&](node_id a, node_id b) { return node(a).day < node(b).day; });
+        for (node_id id: dated) {
+            lower_subtree_min_day(id, node(id).day);
         }
-        add_node(root_name, root_date, root_muts);
-        root = get_node(root_name);
     }
 
-    void add_branch(Node * parent, Node * child, map<string, set<string>>& branch_mutations) {
-        parent->add_child(child);
-        child->set_parent(parent);
-        child->set_branch_mutations(branch_mutations);
+    // Lowers the earliest day below id and its ancestors to day. An ancestor that already has an earlier
+    // day keeps it, and so do its own ancestors. Removing a branch never raises the days above it, so a
+    // subtree_min_day may be earlier than any node left below, which only makes temporal pruning skip less.
+    void lower_subtree_min_day(node_id id, day_t day) {
+        vector<node_id> to_lower = {id};
+        while (!to_lower.empty()) {
+            Node& below = node(to_lower.back());
+            to_lower.pop_back();
+            if (day >= below.subtree_min_day) {
+                continue;
+            }
+            below.subtree_min_day = day;
+            if (record_lowered_days) {
+                lowered_days.push_back(below.id);
+            }
+            // reassortment nodes are below the parent of every segment
+            if (below.parent != NO_NODE) {
+                to_lower.push_back(below.parent);
+            }
+            for (node_id above: below.parent4seg) {
+                if (above != NO_NODE) {
+                    to_lower.push_back(above);
+                }
+            }
+        }
     }
 
-    void remove_branch(Node * parent, Node * child) {
-        child->remove_parent();
-        parent->remove_child(child);
+    // From now on the graft search skips children whose nodes below are all dated later than the sample, which
+    // cannot be its ancestors (--temporal-pruning). Undated samples and undated subtrees are never skipped.
+    void enable_temporal_pruning() {
+        use_temporal_pruning = true;
+    }
+
+    // From now on a graft search that passes search_depth_limit fails the placement of its sample, which is
+    // then not grafted, instead of ending the process, so that a server survives the request
+    void allow_search_failures() {
+        search_failures_allowed = true;
+    }
+
+    // Builds the subtree summaries of the network and keeps them up to date from now on. They let the graft
+    // search skip the children of nodes below which no mutation of the sample is found, at the cost of
+    // updating the summaries of the ancestors of every new branch.
+    void enable_subtree_summaries() {
+        if (!use_subtree_summaries) {
+            use_subtree_summaries = true;
+            build_subtree_summaries();
+        }
+    }
+
+    // Indexes the ancestry of the network along Node::parent (--ancestry-index) and keeps it up to date from
+    // now on. group_placement then classifies two graft nodes by their lowest common ancestor and depths
+    // instead of comparing parents: parent and child are rejected as before, and ancestor and descendant
+    // further apart are counted in NetworkStats::ancestral_reassortments. Like the parent comparison, the
+    // index only follows Node::parent: a reassortment node descends from its first parent alone, so a graft
+    // node below one of its other parents is not seen as its descendant. Every change of parent and every
+    // classification takes the index's lock, which costs grafting time and serializes concurrent placements,
+    // hence the option.
+    void enable_ancestry_index() {
+        if (!ancestry) {
+            ancestry = make_unique<AncestryIndex>();
+            build_ancestry_index();
+        }
+    }
+
+    void build_ancestry_index() {
+        ancestry->clear();
+        for (node_id id = 0; id < nodes.capacity(); id++) {
+            if (nodes.is_live(id) && node(id).parent != NO_NODE) {
+                ancestry->link(id, node(id).parent);
+            }
+        }
+    }
+
+    void build_subtree_summaries() {
+        for (node_id id = 0; id < nodes.capacity(); id++) {
+            if (nodes.is_live(id)) {
+                for (node_id child: node(id).children) {
+                    summarize_branch(id, child);
+                }
+            }
+        }
+    }
+
+    // Adds the branch from parent to child and the subtree summary of child to the summaries of parent and its ancestors.
+    // An ancestor whose summary does not change already covers them, and so do its own ancestors.
+    void summarize_branch(node_id parent_id, node_id child_id) {
+        const Node& child = node(child_id);
+        bool changed = node(parent_id).subtree_summary.add(child.branch_mutations);
+        changed |= node(parent_id).subtree_summary.add(child.subtree_summary);
+        if (!changed) {
+            return;
+        }
+        vector<node_id> updated = {parent_id};
+        while (!updated.empty()) {
+            const Node& below = node(updated.back());
+            updated.pop_back();
+            // reassortment nodes are listed as a child by the parent of every segment
+            auto add_to = [&](node_id above) {
+                if (above != NO_NODE && node(above).subtree_summary.add(below.subtree_summary)) {
+                    updated.push_back(above);
+                }
+            };
+            add_to(below.parent);
+            for (node_id above: below.parent4seg) {
+                add_to(above);
+            }
+        }
+    }
+
+    void build_branch_index(node_id parent_id) {
+        Node& parent = node(parent_id);
+        parent.branch_index = make_unique<BranchIndex>();
+        for (node_id indexed_child: parent.children) {
+            if (node(indexed_child).parent == parent_id) { // reassortment nodes are listed by all their parents, but their branches carry no mutations
+                unindex_branch(parent_id, indexed_child); // children listed more than once are indexed once
+                index_branch(parent_id, indexed_child);
+            }
+        }
+    }
+
+    void remove_branch(node_id parent_id, node_id child_id) {
+        unindex_branch(parent_id, child_id);
+        node(child_id).remove_parent();
+        if (ancestry) {
+            ancestry->cut(child_id);
+        }
+        Node& parent = node(parent_id);
+        parent.remove_child(child_id);
+        for (size_t i = 0; i < parent.children.size(); i++) {
+            if (node(parent.children[i]).parent == parent_id) { // a reassortment node keeps its position below Node::parent
+                node(parent.children[i]).child_index = i;
+            }
+        }
+        update_last_empty_children(parent_id);
+    }
+
+    // A reassortment node moved below a new hidden node takes it as parent for the segments it had from old_parent
+    void replace_parent_for_segs(node_id child_id, node_id old_parent, node_id new_parent) {
+        for (node_id& seg_parent: node(child_id).parent4seg) {
+            if (seg_parent == old_parent) {
+                seg_parent = new_parent;
+            }
+        }
+    }
+
+    void index_branch(node_id parent_id, node_id child_id) {
+        Node& parent = node(parent_id);
+        const Node& child = node(child_id);
+        if (parent.branch_index) {
+            for (size_t seg = 0; seg < child.branch_mutations.size(); seg++) {
+                parent.branch_index->add(child_id, seg, child.branch_mutations[seg]);
+            }
+        }
+    }
+
+    void unindex_branch(node_id parent_id, node_id child_id) {
+        Node& parent = node(parent_id);
+        const Node& child = node(child_id);
+        if (parent.branch_index) {
+            for (size_t seg = 0; seg < child.branch_mutations.size(); seg++) {
+                parent.branch_index->remove(child_id, seg, child.branch_mutations[seg]);
+            }
+        }
+    }
+
+    void update_last_empty_children(node_id parent_id) {
+        Node& parent = node(parent_id);
+        size_t num_unset = parent.last_empty_child.size();
+        fill(parent.last_empty_child.begin(), parent.last_empty_child.end(), -1);
+        for (size_t i = parent.children.size(); i-- > 0 && num_unset > 0;) {
+            const Node& child = node(parent.children[i]);
+            for (size_t seg = 0; seg < parent.last_empty_child.size(); seg++) {
+                if (parent.last_empty_child[seg] == -1 && child.branch_mutations[seg].empty()) {
+                    parent.last_empty_child[seg] = i;
+                    num_unset--;
+                }
+            }
+        }
     }
 
-    // Function to get a node (returns pointer or nullptr if not found)
-    Node * get_node(const string& node_name) const {
-        auto it = nodes.find(node_name);
-        if (it != nodes.end()) {
-            return it->second.get();
+    // Function to get a node (returns its handle or NO_NODE if not found)
+    node_id get_node(const string& node_name) const {
+        auto it = node_ids.find(node_name);
+        if (it != node_ids.end()) {
+            return it->second;
         }
-        return nullptr;
+        return NO_NODE;
     }
 
-    // Function to remove a node
+    // Function to remove a node, its slot is reused by later nodes
     void remove_node(const string& node_name) {
-        if (nodes.erase(node_name) == 0) {
+        auto it = node_ids.find(node_name);
+        if (it == node_ids.end()) {
             cerr << "Error: Node with name '" << node_name << "' does not exist.\n";
+            return;
+        }
+        node_id id = it->second;
+        node_ids.erase(it);
+        genotype_cache.erase(id);
+        if (ancestry) {
+            ancestry->remove(id);
         }
+        nodes.destroy(id);
     }
 
-    // Function to write network to file
-    void print_network() const {
-        map <string,int> num_muts4seg = {};
-        for (string seg_name: seg_names) {
-            num_muts4seg[seg_name] = 0;
-        }
-        int tot_num_muts = 0;
-        cout << "Network Nodes:\n";
-        for (const auto& pair : nodes) {
-            pair.second->print_node();
-        }
-        cout << "Network Edges:\n";
-        for (const auto& pair: nodes) {
-            if (pair.second->parent != nullptr) {
-                cout << "Start: " << pair.second->parent->get_name() << " End: " << pair.second->get_name() << " Mutations: " ;
-                for (const auto& segment_mut_pair : pair.second->branch_mutations) {
-                    const string& segment = segment_mut_pair.first;
-                    const set<string>& mut_set = segment_mut_pair.second;
-                    num_muts4seg[segment] += mut_set.size();
-                    tot_num_muts += mut_set.size();
-                    cout << segment << ":[";
-                    for (auto it = mut_set.begin(); it != mut_set.end(); ++it) {
-                        cout << *it;
-                        if (next(it) != mut_set.end()) cout << ", ";
-                    }
-                    cout << "] ";
+    // Stores only branch mutations from now on (--implicit-genotypes): the sample mutations of every node are
+    // released, now and as each sample is grafted, and rebuilt on demand from the branches on the path from root
+    void enable_implicit_genotypes() {
+        if (!use_implicit_genotypes) {
+            use_implicit_genotypes = true;
+            genotype_cache.reset(seg_names.size(), GENOTYPE_CACHE_MUTS);
+            for (node_id id = 0; id < nodes.capacity(); id++) {
+                if (nodes.is_live(id)) {
+                    release_genotype(id);
                 }
-                cout << endl;
-            }            
+            }
+        }
+    }
+
+    // With implicit genotypes, frees the sample mutations of a node whose branches are final. A sample keeps
+    // only how its genotype differs from the mutations on its path from root: for each segment, the path
+    // mutations it lacks (conflicting mutations of the branches it was grafted below) and the mutations it has
+    // off the path, stored as parts 2 * seg and 2 * seg + 1 of one array that starts with the end offset of
+    // every part. Grafts split and compaction joins branches without changing any node's path mutations, so
+    // the difference stays valid.
+    void release_genotype(node_id id) {
+        Node& n = node(id);
+        if (!use_implicit_genotypes || n.implicit_genotype || n.sample_mutations.empty()) {
+            return;
+        }
+        size_t num_segs = seg_names.size();
+        if (all_of(n.sample_mutations.begin(), n.sample_mutations.end(), [](const mut_set& muts) { return muts.empty(); })) {
+            n.sample_mutations = vector<mut_set>(); // hidden and reassortment nodes, nothing to rebuild
+            return;
         }
-        cout << "Total number of mutations is " << tot_num_muts << endl;
-        for (string seg_name: seg_names) {
-            cout << "Number of mutations in segment " << seg_name << " is " << num_muts4seg[seg_name] << endl;
+        vector<mut_id> delta(2 * num_segs + 1);
+        delta[0] = delta.size();
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            mut_set path = path_mutations(id, seg);
+            mut_set lacking = path;
+            subtract_muts(lacking, n.sample_mutations[seg]);
+            delta.insert(delta.end(), lacking.begin(), lacking.end());
+            delta[2 * seg + 1] = delta.size();
+            mut_set off_path = n.sample_mutations[seg];
+            subtract_muts(off_path, path);
+            delta.insert(delta.end(), off_path.begin(), off_path.end());
+            delta[2 * seg + 2] = delta.size();
         }
+        if (delta[2 * num_segs] > 2 * num_segs + 1) {
+            delta.shrink_to_fit();
+            n.genotype_delta = move(delta);
+        }
+        n.sample_mutations = vector<mut_set>();
+        n.implicit_genotype = true;
     }
 
-    // Function to print all nodes in the network
-    void write_network() const {
-        map <string,int> num_muts4seg = {};
-        for (string seg_name: seg_names) {
-            num_muts4seg[seg_name] = 0;
+    // Union of the branch mutations for seg on the path from root to id, following parent4seg through
+    // reassortment nodes. The walk stops at the first node whose set is cached; the sets of every
+    // GENOTYPE_CACHE_STRIDE-th node above id are cached, so later walks through them are short. The walk
+    // holds genotype_lock, so readers sharing the network may rebuild genotypes at the same time.
+    mut_set path_mutations(node_id id, size_t seg) const {
+        lock_guard<mutex> guard(*genotype_lock);
+        static thread_local vector<node_id> path;
+        path.clear();
+        mut_set muts;
+        for (node_id above = id; above != NO_NODE; above = parent_for_seg(node(above), seg)) {
+            const mut_set * cached = genotype_cache.find(above, seg);
+            if (cached != nullptr) {
+                muts = *cached;
+                break;
+            }
+            path.push_back(above);
         }
-        int tot_num_muts = 0;
-        ofstream out_file(network_file_name);
-        if (!out_file) {
-            cerr << "Error: Unable to open file " << network_file_name << " for writing.\n";
+        for (size_t i = path.size(); i-- > 0;) {
+            unite_muts(muts, node(path[i]).branch_mutations[seg]);
+            if (i > 0 && i % GENOTYPE_CACHE_STRIDE == 0) {
+                genotype_cache.insert(path[i], seg, muts);
+            }
+        }
+        return muts;
+    }
+
+    // Sample mutations of node id for seg, rebuilt from the branches if they were released
+    mut_set sample_genotype(node_id id, size_t seg) const {
+        const Node& n = node(id);
+        if (!n.implicit_genotype) {
+            return n.sample_mutations.empty() ? mut_set() : n.sample_mutations[seg];
+        }
+        mut_set muts = path_mutations(id, seg);
+        if (!n.genotype_delta.empty()) {
+            const mut_id * parts = n.genotype_delta.data();
+            subtract_muts(muts, mut_set(parts + parts[2 * seg], parts + parts[2 * seg + 1]));
+            unite_muts(muts, mut_set(parts + parts[2 * seg + 1], parts + parts[2 * seg + 2]));
+        }
+        return muts;
+    }
+
+    vector<mut_set> sample_genotype(node_id id) const {
+        vector<mut_set> genotype(seg_names.size());
+        for (size_t seg = 0; seg < seg_names.size(); seg++) {
+            genotype[seg] = sample_genotype(id, seg);
+        }
+        return genotype;
+    }
+
+    // Runs compact every interval grafted samples during read_mutations_from_file (--compact), 0 never does
+    void set_compact_interval(size_t interval) {
+        compact_interval = interval;
+    }
+
+    // Whether samples were grafted since the last compaction under --compact, which a network must be
+    // compacted for before it is written, as read_mutations_from_file does at the end
+    bool compaction_pending() const {
+        return compact_interval > 0 && stats.samples_grafted > samples_at_compaction;
+    }
+
+    // Removes the hidden nodes that carry no information: those whose branch has no mutations, which leave
+    // their parent with the same genotype, those with a single child that is not a reassortment node,
+    // whose branch is joined with the child's, and those left without children. Their children move to the parent in their place, with the
+    // hidden node's mutations added to their branches, so every node keeps its path mutations from root
+    // and every sample its genotype. The freed slots are reused by later nodes. Returns the nodes removed.
+    size_t compact() {
+        auto start = chrono::steady_clock::now();
+        vector<bool> removed(nodes.capacity(), false);
+        size_t num_removed = 0;
+        for (node_id id = 0; id < nodes.capacity(); id++) {
+            if (!nodes.is_live(id) || !node(id).hidden_node || node(id).parent == NO_NODE) {
+                continue;
+            }
+            const Node& hidden = node(id);
+            bool empty_branch = all_of(hidden.branch_mutations.begin(), hidden.branch_mutations.end(), [](const mut_set& muts) { return muts.empty(); });
+            bool unary = hidden.children.size() == 1 && !node(hidden.children[0]).reassortment_node; // reassortment branches carry no mutations
+            if (empty_branch || unary || hidden.children.empty()) {
+                removed[id] = true;
+                num_removed++;
+            }
+        }
+        if (num_removed > 0) {
+            // every parent that keeps its place takes over the children of the removed nodes below it at once
+            for (node_id id = 0; id < nodes.capacity(); id++) {
+                if (nodes.is_live(id) && !removed[id] &&
+                    any_of(node(id).children.begin(), node(id).children.end(), [&](node_id child) { return removed[child]; })) {
+                    adopt_children_of_removed(id, removed);
+                }
+            }
+            for (node_id id = 0; id < removed.size(); id++) {
+                if (removed[id]) {
+                    node_ids.erase(node(id).name);
+                    genotype_cache.erase(id);
+                    if (ancestry) {
+                        ancestry->remove(id);
+                    }
+                    nodes.destroy(id);
+                }
+            }
+        }
+        samples_at_compaction = stats.samples_grafted;
+        stats.hidden_nodes_removed += num_removed;
+        stats.compact_seconds += NetworkStats::seconds_since(start);
+        ENTWINE_LOG(LOG_VERBOSE, "Compaction removed " << num_removed << " hidden nodes, " << nodes.size() << " nodes left" << endl);
+        return num_removed;
+    }
+
+    // Replaces the removed nodes among the children of parent by their children, recursively, see compact
+    void adopt_children_of_removed(node_id parent_id, const vector<bool>& removed) {
+        Node& parent = node(parent_id);
+        vector<node_id> children;
+        vector<node_id> adopted; // children moved up from removed nodes, indexed once their branches are final
+        unordered_set<node_id> listed_reassortments; // filled on the first reassortment node moved up
+        children.reserve(parent.children.size());
+        auto adopt = [&](auto& adopt, node_id removed_id) -> void {
+            const Node& hidden = node(removed_id);
+            for (node_id child_id: hidden.children) {
+                Node& child = node(child_id);
+                if (child.reassortment_node) {
+                    replace_parent_for_segs(child_id, removed_id, parent_id);
+                    if (child.parent == removed_id) {
+                        child.parent = parent_id;
+                        if (ancestry) {
+                            ancestry->link(child_id, parent_id);
+                        }
+                    }
+                    if (listed_reassortments.empty()) {
+                        listed_reassortments.insert(NO_NODE);
+                        for (node_id listed: parent.children) {
+                            if (node(listed).reassortment_node) {
+                                listed_reassortments.insert(listed);
+                            }
+                        }
+                    }
+                    if (!listed_reassortments.insert(child_id).second) {
+                        child.in_degree--; // already a child of parent through another of its parents
+                        continue;
+                    }
+                } else {
+                    for (size_t seg = 0; seg < seg_names.size(); seg++) {
+                        unite_muts(child.branch_mutations[seg], hidden.branch_mutations[seg]);
+                    }
+                    child.parent = parent_id;
+                    if (ancestry) {
+                        ancestry->link(child_id, parent_id);
+                    }
+                    if (removed[child_id]) {
+                        adopt(adopt, child_id);
+                        continue;
+                    }
+                    adopted.push_back(child_id);
+                }
+                children.push_back(child_id);
+            }
+        };
+        for (node_id child_id: parent.children) {
+            if (removed[child_id]) {
+                unindex_branch(parent_id, child_id);
+                adopt(adopt, child_id);
+            } else {
+                children.push_back(child_id);
+            }
+        }
+        parent.out_degree += static_cast<int>(children.size()) - static_cast<int>(parent.children.size());
+        parent.children = move(children);
+        for (size_t i = 0; i < parent.children.size(); i++) {
+            if (node(parent.children[i]).parent == parent_id) {
+                node(parent.children[i]).child_index = i;
+            }
+        }
+        update_last_empty_children(parent_id);
+        if (parent.branch_index) {
+            for (node_id child_id: adopted) {
+                index_branch(parent_id, child_id);
+            }
+        } else if (parent.children.size() >= BRANCH_INDEX_MIN_CHILDREN) {
+            build_branch_index(parent_id);
+        }
+    }
+
+    // Writes the network to file_name in one pass over the nodes, which also prints every node and edge
+    // to stdout at LOG_VERBOSE
+    void write_network(const string& file_name) {
+        auto start = chrono::steady_clock::now();
+        vector<size_t> num_muts4seg(seg_names.size(), 0);
+        size_t tot_num_muts = 0;
+        BufferedWriter out_file;
+        if (!out_file.open(file_name)) {
+            cerr << "Error: Unable to open file " << file_name << " for writing.\n";
             return;
         }
     
+        bool print = ENTWINE_LOG_ENABLED(LOG_VERBOSE);
         out_file << "Network Nodes:\n";
-        for (const auto& pair : nodes) {
-            out_file << pair.second->get_name() << "\n"; // Assuming get_name() exists for node names
+        for (node_id id = 0; id < nodes.capacity(); id++) {
+            if (nodes.is_live(id)) {
+                out_file << node(id).get_name() << "\n";
+                if (print) {
+                    node(id).print_node(seg_names, mutation_dict, sample_genotype(id));
+                }
+            }
         }
     
         out_file << "Network Edges:\n";
-        for (const auto& pair : nodes) {
-            if (pair.second->parent != nullptr) {
-                out_file << "Start: " << pair.second->parent->get_name() 
-                         << " End: " << pair.second->get_name() 
-                         << " Mutations: ";
-    
-                for (const auto& segment_mut_pair : pair.second->branch_mutations) {
-                    const string& segment = segment_mut_pair.first;
-                    const set<string>& mut_set = segment_mut_pair.second;
-                    num_muts4seg[segment] += mut_set.size();
-                    tot_num_muts += mut_set.size();
-                    out_file << segment << ":[";
-                    for (auto it = mut_set.begin(); it != mut_set.end(); ++it) {
-                        out_file << *it;
-                        if (next(it) != mut_set.end()) out_file << ", ";
-                    }
-                    out_file << "] ";
+        auto write_edge = [&](auto& out, const Node& child) {
+            out << "Start: " << node(child.parent).get_name() 
+                << " End: " << child.get_name() 
+                << " Mutations: ";
+            for (size_t seg = 0; seg < seg_names.size(); seg++) {
+                out << seg_names[seg] << ":[";
+                mutation_dict.write_names(out, child.branch_mutations[seg]);
+                out << "] ";
+            }
+            out << "\n";
+        };
+        for (node_id id = 0; id < nodes.capacity(); id++) {
+            if (nodes.is_live(id) && node(id).parent != NO_NODE) {
+                const Node& child = node(id);
+                for (size_t seg = 0; seg < seg_names.size(); seg++) {
+                    num_muts4seg[seg] += child.branch_mutations[seg].size();
+                    tot_num_muts += child.branch_mutations[seg].size();
+                }
+                write_edge(out_file, child);
+                if (print) {
+                    write_edge(cout, child);
                 }
-                out_file << "\n";
             }            
         }
-        out_file << "Total number of mutations: " << tot_num_muts << endl;
-        cout << "Total number of mutations is " << tot_num_muts << endl;
-        for (string seg_name: seg_names) {
-            cout << "Number of mutations in segment " << seg_name << " is " << num_muts4seg[seg_name] << endl;
+        out_file << "Total number of mutations: " << tot_num_muts << "\n";
+        ENTWINE_LOG(LOG_INFO, "Total number of mutations is " << tot_num_muts << endl);
+        for (size_t seg = 0; seg < seg_names.size(); seg++) {
+            ENTWINE_LOG(LOG_INFO, "Number of mutations in segment " << seg_names[seg] << " is " << num_muts4seg[seg] << endl);
+        }
+        if (!out_file.close()) {
+            cerr << "Error: Failed writing " << file_name << endl;
+        }
+        stats.write_seconds += NetworkStats::seconds_since(start);
+    }
+
+    // Parent of node for segment seg: reassortment nodes have one per segment, other nodes the same for all
+    node_id parent_for_seg(const Node& n, size_t seg) const {
+        return (n.reassortment_node && !n.parent4seg.empty() && n.parent4seg[seg] != NO_NODE) ? n.parent4seg[seg] : n.parent;
+    }
+
+    // Writes the network as a tab-separated edge list with one row per edge and segment. The parent of a
+    // reassortment node is the parent of that segment, so every segment's tree can be read off the rows.
+    void write_edge_list(const string& file_name) {
+        auto start = chrono::steady_clock::now();
+        BufferedWriter out_file;
+        if (!out_file.open(file_name)) {
+            cerr << "Error: Unable to open file " << file_name << " for writing.\n";
+            return;
+        }
+        out_file << "Parent\tChild\tSegment\tNumMutations\tMutations\n";
+        for (node_id id = 0; id < nodes.capacity(); id++) {
+            if (!nodes.is_live(id) || node(id).parent == NO_NODE) {
+                continue;
+            }
+            const Node& child = node(id);
+            for (size_t seg = 0; seg < seg_names.size(); seg++) {
+                const mut_set& muts = child.branch_mutations[seg];
+                out_file << node(parent_for_seg(child, seg)).name << '\t' << child.name << '\t' << seg_names[seg] << '\t' << muts.size() << '\t';
+                mutation_dict.write_names(out_file, muts, ":");
+                out_file << '\n';
+            }
+        }
+        if (!out_file.close()) {
+            cerr << "Error: Failed writing " << file_name << endl;
+        }
+        stats.write_seconds += NetworkStats::seconds_since(start);
+    }
+
+    // Writes the network in extended Newick format. A reassortment node is written with its subtree under the
+    // first parent that lists it and as a bare "R_k#Hk" leaf under its other parents. Branch lengths are the
+    // number of mutations on the branch, summed over segments. Samples that were left without a parent are
+    // not reachable from root and are not written.
+    void write_enewick(const string& file_name) {
+        auto start = chrono::steady_clock::now();
+        BufferedWriter out_file;
+        if (!out_file.open(file_name)) {
+            cerr << "Error: Unable to open file " << file_name << " for writing.\n";
+            return;
+        }
+        auto write_label = [&](const Node& n) {
+            if (n.name.find_first_of(" \t()[]':;,") == string::npos) {
+                out_file << n.name;
+            } else { // quoted label, quotes doubled
+                out_file << '\'';
+                for (char c: n.name) {
+                    out_file << c;
+                    if (c == '\'') {
+                        out_file << c;
+                    }
+                }
+                out_file << '\'';
+            }
+            if (n.reassortment_node) {
+                out_file << "#H" << n.name.substr(n.name.find('_') + 1);
+            }
+        };
+        auto write_length = [&](const Node& n) {
+            size_t num_muts = 0;
+            for (const mut_set& muts: n.branch_mutations) {
+                num_muts += muts.size();
+            }
+            out_file << ':' << num_muts;
+        };
+        // Iterative depth-first traversal, networks can be deeper than the call stack allows
+        vector<bool> written(nodes.capacity(), false);
+        vector<pair<node_id, size_t>> stack = {{root, 0}}; // node and the next of its children to visit
+        written[root] = true;
+        while (!stack.empty()) {
+            auto& [id, next_child] = stack.back();
+            const Node& n = node(id);
+            if (next_child < n.children.size()) {
+                out_file << (next_child == 0 ? '(' : ',');
+                node_id child = n.children[next_child++];
+                if (written[child]) {
+                    write_label(node(child));
+                    write_length(node(child));
+                } else {
+                    written[child] = true;
+                    if (node(child).children.empty()) {
+                        write_label(node(child));
+                        write_length(node(child));
+                    } else {
+                        stack.emplace_back(child, 0);
+                    }
+                }
+                continue;
+            }
+            if (!n.children.empty()) {
+                out_file << ')';
+            }
+            write_label(n);
+            if (id != root) {
+                write_length(n);
+            }
+            stack.pop_back();
+        }
+        out_file << ";\n";
+        if (!out_file.close()) {
+            cerr << "Error: Failed writing " << file_name << endl;
         }
-        out_file.close();
+        stats.write_seconds += NetworkStats::seconds_since(start);
     }
 
-    void graft_at_root(const string& node_name, const string& date, map<string, set<string>>& mutations) {
+    // Writes the network to a binary snapshot (see Snapshot.h) from which load_snapshot restores it exactly
+    bool save_snapshot(const string& file_name) const {
+        static const mut_set no_muts;
+        size_t num_segs = seg_names.size();
+        node_id num_slots = nodes.capacity();
+        SnapshotWriter writer;
+        writer.header.num_segments = num_segs;
+        writer.header.root = root;
+        writer.header.r_index = r_index;
+        writer.header.h_index = h_index;
+        for (const string& seg_name: seg_names) {
+            writer.seg_names.push_back(writer.add_string(seg_name));
+        }
+        for (mut_id mut = 0; mut < mutation_dict.size(); mut++) {
+            writer.mutations.push_back(writer.add_string(mutation_dict.name(mut)));
+        }
+        writer.nodes.resize(num_slots);
+        for (node_id id = 0; id < num_slots; id++) {
+            SnapshotNode& record = writer.nodes[id];
+            record.parent = NO_NODE;
+            if (!nodes.is_live(id)) {
+                continue;
+            }
+            const Node& n = node(id);
+            record.name = writer.add_string(n.name);
+            record.date = writer.add_string(n.date);
+            record.links_offset = writer.links.size();
+            record.num_children = n.children.size();
+            record.num_parent4seg = n.parent4seg.size();
+            writer.links.insert(writer.links.end(), n.children.begin(), n.children.end());
+            writer.links.insert(writer.links.end(), n.parent4seg.begin(), n.parent4seg.end());
+            record.parent = n.parent;
+            record.child_index = n.child_index;
+            record.in_degree = n.in_degree;
+            record.out_degree = n.out_degree;
+            record.flags = SNAPSHOT_NODE_LIVE | (n.reassortment_node ? SNAPSHOT_NODE_REASSORTMENT : 0) | (n.hidden_node ? SNAPSHOT_NODE_HIDDEN : 0);
+        }
+        for (node_id id = 0; id < num_slots; id++) {
+            for (size_t seg = 0; seg < num_segs; seg++) {
+                if (nodes.is_live(id) && node(id).implicit_genotype) {
+                    writer.add_cell(sample_genotype(id, seg));
+                } else {
+                    writer.add_cell(nodes.is_live(id) && !node(id).sample_mutations.empty() ? node(id).sample_mutations[seg] : no_muts);
+                }
+            }
+        }
+        for (node_id id = 0; id < num_slots; id++) {
+            for (size_t seg = 0; seg < num_segs; seg++) {
+                writer.add_cell(nodes.is_live(id) ? node(id).branch_mutations[seg] : no_muts);
+            }
+        }
+        writer.free_slots = nodes.free_list();
+        return writer.write(file_name);
+    }
+
+    // Restores a network written by save_snapshot into this network, which must be empty.
+    // Nodes keep their handles; branch indexes and last-empty-child positions are rebuilt.
+    bool load_snapshot(const string& file_name) {
+        auto start = chrono::steady_clock::now();
+        if (nodes.capacity() > 0) {
+            cerr << "Error: A snapshot can only be loaded into an empty network" << endl;
+            return false;
+        }
+        SnapshotView snapshot;
+        if (!snapshot.open(file_name)) {
+            return false;
+        }
+        const SnapshotHeader& header = snapshot.header();
+        const StringRef * seg_name_refs = snapshot.array<StringRef>(header.seg_names);
+        const StringRef * mutation_refs = snapshot.array<StringRef>(header.mutations);
+        const SnapshotNode * records = snapshot.array<SnapshotNode>(header.nodes);
+        const uint32_t * links = snapshot.array<uint32_t>(header.links);
+        const uint64_t * cells = snapshot.array<uint64_t>(header.cells);
+        const uint32_t * muts = snapshot.array<uint32_t>(header.muts);
+        const uint32_t * free_slots = snapshot.array<uint32_t>(header.free_slots);
+        size_t num_segs = header.num_segments;
+        uint64_t num_slots = header.nodes.count;
+        auto corrupt = [&]() {
+            cerr << "Error: Snapshot " << file_name << " is truncated or corrupt" << endl;
+            nodes = SlabArena<Node>();
+            node_ids.clear();
+            mutation_dict = MutationDictionary();
+            if (ancestry) {
+                ancestry->clear();
+            }
+            root = NO_NODE;
+            return false;
+        };
+
+        seg_names.clear();
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            if (!snapshot.valid_string(seg_name_refs[seg])) {
+                return corrupt();
+            }
+            seg_names.emplace_back(snapshot.str(seg_name_refs[seg]));
+        }
+        genotype_cache.reset(seg_names.size(), GENOTYPE_CACHE_MUTS);
+        for (uint64_t mut = 0; mut < header.mutations.count; mut++) {
+            if (!snapshot.valid_string(mutation_refs[mut]) || mutation_dict.intern(snapshot.str(mutation_refs[mut])) != mut) {
+                return corrupt();
+            }
+        }
+        if (num_slots >= NO_NODE || header.free_slots.count > num_slots || header.root >= num_slots ||
+            cells[0] != 0 || cells[header.cells.count - 1] > header.muts.count) {
+            return corrupt();
+        }
+
+        // Nodes are filled in parallel, one slab-sized block of slots per task
+        const size_t block_size = 4096;
+        for (uint64_t slot = 0; slot < num_slots; slot++) {
+            nodes.create();
+        }
+        atomic<bool> is_corrupt{false};
+        auto copy_cell = [&](uint64_t cell, mut_set& cell_muts) {
+            uint64_t first = cells[cell], last = cells[cell + 1];
+            if (first > last || last > header.muts.count) {
+                return false;
+            }
+            cell_muts.assign(muts + first, muts + last);
+            return all_of(cell_muts.begin(), cell_muts.end(), [&](mut_id mut) { return mut < header.mutations.count; });
+        };
+        auto is_live_slot = [&](node_id id) { // every node a record refers to must be saved too
+            return id < num_slots && (records[id].flags & SNAPSHOT_NODE_LIVE);
+        };
+        thread_pool->parallel_for((num_slots + block_size - 1) / block_size, [&](size_t block) {
+            for (uint64_t slot = block * block_size; slot < min<uint64_t>(num_slots, (block + 1) * block_size); slot++) {
+                const SnapshotNode& record = records[slot];
+                if (!(record.flags & SNAPSHOT_NODE_LIVE)) {
+                    continue;
+                }
+                uint64_t num_links = uint64_t(record.num_children) + record.num_parent4seg;
+                if (!snapshot.valid_string(record.name) || !snapshot.valid_string(record.date) ||
+                    record.links_offset > header.links.count || num_links > header.links.count - record.links_offset ||
+                    (record.num_parent4seg != 0 && record.num_parent4seg != num_segs) ||
+                    (record.parent != NO_NODE && !is_live_slot(record.parent))) {
+                    is_corrupt = true;
+                    return;
+                }
+                const uint32_t * node_links = links + record.links_offset;
+                if (!all_of(node_links, node_links + record.num_children, is_live_slot) ||
+                    !all_of(node_links + record.num_children, node_links + num_links, [&](node_id parent) { return parent == NO_NODE || is_live_slot(parent); })) {
+                    is_corrupt = true;
+                    return;
+                }
+                Node& n = nodes[slot];
+                n.id = slot;
+                n.name = snapshot.str(record.name);
+                n.date = snapshot.str(record.date);
+                n.in_degree = record.in_degree;
+                n.out_degree = record.out_degree;
+                n.parent = record.parent;
+                n.child_index = record.child_index;
+                n.reassortment_node = record.flags & SNAPSHOT_NODE_REASSORTMENT;
+                n.hidden_node = record.flags & SNAPSHOT_NODE_HIDDEN;
+                n.day = n.hidden_node || n.reassortment_node || slot == header.root ? NO_DAY : parse_day(n.date); // older snapshots hold placeholder dates for these
+                n.children.assign(node_links, node_links + record.num_children);
+                n.parent4seg.assign(node_links + record.num_children, node_links + num_links);
+                n.sample_mutations.resize(num_segs);
+                n.branch_mutations.resize(num_segs);
+                for (size_t seg = 0; seg < num_segs; seg++) {
+                    if (!copy_cell(slot * num_segs + seg, n.sample_mutations[seg]) ||
+                        !copy_cell((num_slots + slot) * num_segs + seg, n.branch_mutations[seg])) {
+                        is_corrupt = true;
+                        return;
+                    }
+                }
+            }
+        });
+        if (is_corrupt) {
+            return corrupt();
+        }
+        size_t num_dead = 0;
+        for (uint64_t slot = 0; slot < num_slots; slot++) {
+            num_dead += !(records[slot].flags & SNAPSHOT_NODE_LIVE);
+        }
+        if (num_dead != header.free_slots.count) {
+            return corrupt();
+        }
+        for (uint64_t i = 0; i < header.free_slots.count; i++) { // in saved order, so slots are reused as they would have been
+            if (free_slots[i] >= num_slots || (records[free_slots[i]].flags & SNAPSHOT_NODE_LIVE) || !nodes.is_live(free_slots[i])) {
+                return corrupt();
+            }
+            nodes.destroy(free_slots[i]);
+        }
+        if (!nodes.is_live(header.root)) {
+            return corrupt();
+        }
+        node_ids.reserve(nodes.size());
+        for (node_id id = 0; id < num_slots; id++) {
+            if (nodes.is_live(id) && !node_ids.emplace(string_view(node(id).name), id).second) {
+                return corrupt();
+            }
+        }
+        // Children must be live before the per-parent data that reads them is rebuilt
+        for (node_id id = 0; id < num_slots; id++) {
+            if (nodes.is_live(id)) {
+                const Node& n = node(id);
+                if (any_of(n.children.begin(), n.children.end(), [&](node_id child) { return !nodes.is_live(child); })) {
+                    return corrupt();
+                }
+            }
+        }
+        thread_pool->parallel_for((num_slots + block_size - 1) / block_size, [&](size_t block) {
+            for (node_id id = block * block_size; id < min<uint64_t>(num_slots, (block + 1) * block_size); id++) {
+                if (nodes.is_live(id) && !node(id).children.empty()) {
+                    node(id).last_empty_child.assign(num_segs, -1);
+                    update_last_empty_children(id);
+                    if (node(id).children.size() >= BRANCH_INDEX_MIN_CHILDREN) {
+                        build_branch_index(id);
+                    }
+                }
+            }
+        });
+        if (ancestry) {
+            build_ancestry_index(); // nor is ancestry
+        }
+        build_subtree_min_days();
+        if (use_subtree_summaries) {
+            build_subtree_summaries(); // summaries are not saved
+        }
+        root = header.root;
+        mut_id_bound = mutation_dict.size();
+        r_index = header.r_index;
+        h_index = header.h_index;
+        stats.segments.assign(num_segs, SegmentSearchStats());
+        stats.load_seconds += NetworkStats::seconds_since(start);
+        return true;
+    }
+
+    void graft_at_root(const string& node_name, const string& date, vector<mut_set>& mutations) {
         // cout << "Grafting " << node_name;
-        add_node(node_name, date, mutations);
-        Node * node = get_node(node_name);
-        int net_size = nodes.size();
-        assert(net_size == 2);
+        node_id sample = add_node(node_name, date, mutations);
+        if (sample == NO_NODE) {
+            return;
+        }
+        assert(nodes.size() == 2);
         // cout << " as child of root" << endl;
-        add_branch(root, node, mutations);
+        add_branch(root, sample, mutations);
+        release_genotype(sample);
+        stats.samples_grafted++;
     }
 
 
 
     
-    void graft_sample(const string& node_name, const string& date, map<string, set<string>>& mutations) {
-        bool debug = true;
-        add_node(node_name, date, mutations);
-        Node * sample_node = get_node(node_name);
-        Node * graft_node;
-        map <string,tuple<Node *, set<string>, set<string>>> graft_info;               
-        map <Node*, vector<string>> reassortment_groups;
-        for (string seg: seg_names) {
-            graft_info[seg] = get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(sample_node,seg);
-            graft_node = get<0>(graft_info[seg]);
-            if (debug) {
-                cout << "Graft node is " << graft_node->name << " for segment " << seg << endl;
-                cout << "Number of sample mutations in sample are " << sample_node->sample_mutations[seg].size() << endl;
-                cout << "Number of unique mutations in sample are " << get<1>(graft_info[seg]).size() << endl;
-                cout << "Number of conflicting mutations in optimal path are " << get<2>(graft_info[seg]).size() << endl;
-                cout << "--------------------------------------------------------------------" << endl;
-                
-            }
-            if (reassortment_groups.count(graft_node)) {
-                reassortment_groups[graft_node].push_back(seg);
-            } else {
-                reassortment_groups[graft_node] = vector<string>({seg});
-            }            
+    void graft_sample(string node_name, string date, vector<mut_set> mutations) {
+        auto start = chrono::steady_clock::now();
+        // The searches only read the network, so segments are searched concurrently and merged in segment order
+        Placement placement = place_sample(mutations, node_name, true, &stats.segments, parse_day(date, true));
+        if (placement.search_failed) {
+            cerr << "Error: Could not graft " << node_name << ", its search passed the depth limit" << endl;
+            return;
         }
-        if (reassortment_groups.size() > 1) { // If there are two groups and graft node of one group is parent of another then it is not reassortment. 
-                                              // If graft nodes are not parent-child then it is reassortment
-            bool parent_child = false;
-            if (reassortment_groups.size() == 2) {   
-                cout << "Two groups" << endl;           
-                for (auto group1: reassortment_groups) {
-                    for (auto group2: reassortment_groups) {
-                        if (group1.first->parent == group2.first || group2.first->parent == group1.first) {
-                            cout << "parent-child" << endl;                            
-                            if (group1.first != group2.first) {
-                                parent_child = true;
-                                cout << "parent-child" << endl;
-                                // exit(-1);
-                            }                            
-                        }
-                    }
-                }                
-            }
-            if (parent_child) {
-                cout << "parent-child" << endl;
+        node_id sample = add_node(move(node_name), move(date), move(mutations));
+        if (sample == NO_NODE) {
+            return;
+        }
+        auto searched = chrono::steady_clock::now();
+        stats.search_seconds += chrono::duration<double>(searched - start).count();
+        apply_placement(sample, placement);
+        stats.graft_seconds += NetworkStats::seconds_since(searched);
+        stats.samples_grafted++;
+    }
+
+    // Grafts sample, a node without parent, where placement says. The unique mutations of the sample
+    // are moved out of placement into the new branches, and its genotype is released if implicit.
+    void apply_placement(node_id sample, Placement& placement) {
+        node_id graft_node;
+        vector <tuple<node_id, mut_set, mut_set>>& graft_info = placement.graft_info;
+        const vector <pair<node_id, vector<size_t>>>& reassortment_groups = placement.reassortment_groups;
+        if (reassortment_groups.size() > 1) {
+            if (placement.parent_child) {
+                ENTWINE_LOG(LOG_DEBUG, "parent-child" << endl);
+                stats.parent_child_rejections++;
 
             } else {
-                if (debug) {
-                    cout << "Reassortment detected" << endl;
-                }            
+                ENTWINE_LOG(LOG_DEBUG, "Reassortment detected" << endl);
+                stats.ancestral_reassortments += placement.ancestral;
                 string R_name = "R_" + to_string(r_index);
                 r_index ++;
-                string R_date = "2025-03-14";
-                map <string, set<string>> R_muts;
-                for (string& seg_name: seg_names) {
-                    R_muts[seg_name] = set<string>();
-                }
-                add_node(R_name, R_date, R_muts);
-                Node * R_node = get_node(R_name);
-                R_node->reassortment_node = true;
+                node_id R_node = add_node(R_name, "", vector<mut_set>(seg_names.size())); // dated by its subtree
+                node(R_node).reassortment_node = true;
+                release_genotype(R_node);
+                stats.reassortment_nodes_created++;
                 // R_node->set_branch_mutations(R_muts);
-                for (auto graft_node_seg_list_pair: reassortment_groups) {
-                    Node * graft_node = graft_node_seg_list_pair.first;
-                    vector<string> seg_list = graft_node_seg_list_pair.second; 
-                    // cout << "Graft node is " << graft_node->name << " for segments "; for (string seg: seg_list) {cout << seg << " ";} cout << endl; 
-                    Node * parent_node = graft_node->parent;
+                vector<mut_set> sample_branch_uniq_muts(seg_names.size());
+                for (size_t seg = 0; seg < seg_names.size(); seg++) {
+                    sample_branch_uniq_muts[seg] = move(get<1>(graft_info[seg]));
+                }
+                for (const auto& graft_node_seg_list_pair: reassortment_groups) {
+                    node_id graft_node = graft_node_seg_list_pair.first;
+                    const vector<size_t>& seg_list = graft_node_seg_list_pair.second;
+                    // cout << "Graft node is " << node(graft_node).name << " for segments "; for (size_t seg: seg_list) {cout << seg_names[seg] << " ";} cout << endl; 
+                    if (graft_node == root) { // no branch to split, segments of this group descend directly from root
+                        for (size_t seg: seg_list) {
+                            node(R_node).setParentForSegment(seg,root);
+                        }
+                        add_branch(root, R_node, vector<mut_set>(seg_names.size()));
+                        continue;
+                    }
+                    node_id parent_node = node(graft_node).parent;
                     string H_name = "H_" + to_string(h_index) + "_" + R_name;
                     h_index++;
-                    string H_date = "";
-                    map <string, set<string>> H_muts;
-                    for (string& seg_name: seg_names) {
-                        H_muts[seg_name] = set<string>();
-                    }
-                    add_node(H_name, H_date, H_muts);
-                    Node * H_node = get_node(H_name);
-                    map<string,set<string>> graft_branch_uniq_muts;
-                    map<string,set<string>> graft_branch_common_muts;
-                    map<string,set<string>> reassortment_branch_seg_list;
-                    map<string,set<string>> graft_branch_all_muts = graft_node->getBranchMutations();
-                    for (string seg: seg_names) {
+                    node_id H_node = add_node(move(H_name), "", vector<mut_set>(seg_names.size()));
+                    node(H_node).hidden_node = true;
+                    release_genotype(H_node);
+                    stats.hidden_nodes_created++;
+                    vector<mut_set> graft_branch_uniq_muts(seg_names.size());
+                    vector<mut_set> graft_branch_common_muts(seg_names.size());
+                    const vector<mut_set>& graft_branch_all_muts = node(graft_node).branch_mutations; // read before remove_branch clears it
+                    for (size_t seg = 0; seg < seg_names.size(); seg++) {
                         if (find(seg_list.begin(),seg_list.end(),seg) != seg_list.end()) {  // seg is in seg_list                     
-                            R_node->setParentForSegment(seg,H_node);
-                            set<string> conflicting_muts_on_opt_path = get<2>(graft_info[seg]);
-                            for (string mut: graft_branch_all_muts[seg]) {
-                                if (conflicting_muts_on_opt_path.count(mut)) {
-                                    graft_branch_uniq_muts[seg].emplace(mut);
-                                } else {
-                                    graft_branch_common_muts[seg].emplace(mut);
-                                }
-                            }
+                            node(R_node).setParentForSegment(seg,H_node);
+                            const mut_set& conflicting_muts_on_opt_path = get<2>(graft_info[seg]);
+                            split_muts(graft_branch_all_muts[seg], conflicting_muts_on_opt_path, graft_branch_uniq_muts[seg], graft_branch_common_muts[seg]);
+                            stats.graft_set_operations++;
                         } else {  // seg is not in seg_list
-                            graft_branch_common_muts[seg] = set<string>();
+                            graft_branch_common_muts[seg] = mut_set();
                             graft_branch_uniq_muts[seg] = graft_branch_all_muts[seg];
                         }                    
                     }                
                     remove_branch(parent_node, graft_node);
-                    add_branch(parent_node, H_node, graft_branch_common_muts);
-                    add_branch(H_node, graft_node, graft_branch_uniq_muts);
-                    add_branch(H_node, R_node, R_muts);
-                    map<string,set<string>> sample_branch_uniq_muts; 
-                    for (string seg: seg_names) {
-                        sample_branch_uniq_muts[seg] = get<1>(graft_info[seg]);
-                    }
-                    add_branch(R_node, sample_node, sample_branch_uniq_muts);
+                    add_branch(parent_node, H_node, move(graft_branch_common_muts));
+                    add_branch(H_node, graft_node, move(graft_branch_uniq_muts));
+                    replace_parent_for_segs(graft_node, parent_node, H_node);
+                    add_branch(H_node, R_node, vector<mut_set>(seg_names.size()));
                 }
+                add_branch(R_node, sample, move(sample_branch_uniq_muts));
             }                                                          
         } else {            
-            graft_node = get<0>(graft_info[seg_names[0]]);
-            if (graft_node->name == "Root") {
-                assert(graft_node->in_degree == 0);
-                cout << " as child of root" << endl;
-                add_branch(root, sample_node, mutations);
+            graft_node = get<0>(graft_info[0]);
+            if (graft_node == root) {
+                assert(node(graft_node).in_degree == 0);
+                ENTWINE_LOG(LOG_VERBOSE, " as child of root" << endl);
+                add_branch(root, sample, node(sample).sample_mutations);
             } else {
-                Node * parent_node = graft_node->parent;
-                cout << " along branch from " << parent_node->name << " to " << graft_node->name << endl;
-                map<string,set<string>> sample_branch_uniq_muts; 
-                for (string seg: seg_names) {
-                    sample_branch_uniq_muts[seg] = get<1>(graft_info[seg]);
-                }
-                map<string,set<string>> graft_branch_common_muts;
-                map<string,set<string>> graft_branch_uniq_muts; 
-                map<string,set<string>> graft_branch_all_muts = graft_node->getBranchMutations();
-                for (string seg: seg_names) {
-                    set<string> conflicting_muts_on_opt_path = get<2>(graft_info[seg]);
-                    graft_branch_common_muts[seg] = set<string>();
-                    graft_branch_uniq_muts[seg] = set<string>();
-                    for (string mut: graft_branch_all_muts[seg]) {
-                        if (conflicting_muts_on_opt_path.count(mut)) {
-                            graft_branch_uniq_muts[seg].emplace(mut); // hidden_node to graft_node
-                        } else {
-                            graft_branch_common_muts[seg].emplace(mut); // parent_node to hidden_node
-                        }
-                    }
+                node_id parent_node = node(graft_node).parent;
+                ENTWINE_LOG(LOG_VERBOSE, " along branch from " << node(parent_node).name << " to " << node(graft_node).name << endl);
+                vector<mut_set> sample_branch_uniq_muts(seg_names.size()); 
+                for (size_t seg = 0; seg < seg_names.size(); seg++) {
+                    sample_branch_uniq_muts[seg] = move(get<1>(graft_info[seg]));
                 }
+                vector<mut_set> graft_branch_common_muts(seg_names.size()); // parent_node to hidden_node
+                vector<mut_set> graft_branch_uniq_muts(seg_names.size()); // hidden_node to graft_node
+                const vector<mut_set>& graft_branch_all_muts = node(graft_node).branch_mutations; // read before remove_branch clears it
+                for (size_t seg = 0; seg < seg_names.size(); seg++) {
+                    const mut_set& conflicting_muts_on_opt_path = get<2>(graft_info[seg]);
+                    split_muts(graft_branch_all_muts[seg], conflicting_muts_on_opt_path, graft_branch_uniq_muts[seg], graft_branch_common_muts[seg]);
+                }
+                stats.graft_set_operations += seg_names.size();
                 remove_branch(parent_node, graft_node);
 
                 string H_name = "H_" + to_string(h_index);
                 h_index ++;
-                string H_date = "0000-00-30"; // set using input data TMP_FLG
-                map <string, set<string>> H_muts;
-                for (string& seg_name: seg_names) {
-                    H_muts[seg_name] = set<string>();
-                }
-                add_node(H_name, H_date, H_muts);
-                Node * hidden_node = get_node(H_name);
-                // cout << "Hidden node is " << hidden_node->name << endl;
-                add_branch(parent_node, hidden_node, graft_branch_common_muts);
-                add_branch(hidden_node, graft_node, graft_branch_uniq_muts);
-                add_branch(hidden_node, sample_node, sample_branch_uniq_muts);
+                node_id hidden_node = add_node(move(H_name), "", vector<mut_set>(seg_names.size()));
+                node(hidden_node).hidden_node = true;
+                release_genotype(hidden_node);
+                stats.hidden_nodes_created++;
+                // cout << "Hidden node is " << node(hidden_node).name << endl;
+                add_branch(parent_node, hidden_node, move(graft_branch_common_muts));
+                add_branch(hidden_node, graft_node, move(graft_branch_uniq_muts));
+                replace_parent_for_segs(graft_node, parent_node, hidden_node);
+                add_branch(hidden_node, sample, move(sample_branch_uniq_muts));
             }
         }
+        release_genotype(sample);
     }
 
-    // positions that are shared by uniq_muts_in_sample and conflicting_muts_in_opt_path may be reversions or sign of reassortment/recombination
-    tuple <Node *, set<string>, set<string>> get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(Node * sample_node, string seg) {
-        bool debug = false;
-        Node * graft_node; // (globally optimal) node to find
-        Node * opt_node = root; // opt node among children of search node
-        Node * search_node = root;
-        // opt_node = search_node;
-        set<string> uniq_muts_in_sample = sample_node->sample_mutations[seg];
-        set<string> matching_muts_child_branch;
-        set<string> conflicting_muts_child_branch;
-        set<string> matching_muts_opt_branch;
-        set<string> conflicting_muts_opt_branch;
-        set<string> conflicting_muts_opt_path;
-        bool no_muts_on_branch = false;
-        int opt_branch_matching_muts_count;
-        int child_branch_matching_muts_count;
-        bool continue_search = true;
-        int loop_count = 0;
-        // cout << endl;
-        while (continue_search) {     
-            if (debug) {
-                cout << "search node is " << search_node->name << " for segment " << seg << endl;
+    // Finds where a sample with the given mutations would be grafted, without changing the network.
+    // Segments are searched concurrently if segments_in_parallel is set; search_stats, if given, is indexed by segment.
+    // sample_day is the latest day the sample's date may stand for, see get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg.
+    Placement place_sample(const vector<mut_set>& mutations, const string& sample_name, bool segments_in_parallel, vector<SegmentSearchStats> * search_stats = nullptr, day_t sample_day = NO_DAY) const {
+        Placement placement;
+        placement.graft_info.resize(seg_names.size());
+        auto search_seg = [&](size_t seg) {
+            placement.graft_info[seg] = get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(mutations[seg], sample_name, seg, search_stats != nullptr ? &(*search_stats)[seg] : nullptr, nullptr, sample_day);
+        };
+        if (segments_in_parallel) {
+            thread_pool->parallel_for(seg_names.size(), search_seg);
+        } else {
+            for (size_t seg = 0; seg < seg_names.size(); seg++) {
+                search_seg(seg);
+            }
+        }
+        placement.search_failed = any_of(placement.graft_info.begin(), placement.graft_info.end(), [](const tuple<node_id, mut_set, mut_set>& info) { return get<0>(info) == NO_NODE; });
+        if (!placement.search_failed) {
+            group_placement(placement, mutations);
+        }
+        return placement;
+    }
+
+    // Groups the segments of placement by graft node and checks whether two groups are parent and child
+    void group_placement(Placement& placement, const vector<mut_set>& mutations) const {
+        const vector <tuple<node_id, mut_set, mut_set>>& graft_info = placement.graft_info;
+        vector <pair<node_id, vector<size_t>>>& reassortment_groups = placement.reassortment_groups;
+        reassortment_groups.clear();
+        placement.parent_child = false;
+        placement.ancestral = false;
+        for (size_t seg = 0; seg < seg_names.size(); seg++) {
+            node_id graft_node = get<0>(graft_info[seg]);
+            ENTWINE_LOG(LOG_DEBUG, "Graft node is " << node(graft_node).name << " for segment " << seg_names[seg] << endl
+                << "Number of sample mutations in sample are " << mutations[seg].size() << endl
+                << "Number of unique mutations in sample are " << get<1>(graft_info[seg]).size() << endl
+                << "Number of conflicting mutations in optimal path are " << get<2>(graft_info[seg]).size() << endl
+                << "--------------------------------------------------------------------" << endl);
+            auto group = find_if(reassortment_groups.begin(),reassortment_groups.end(),[graft_node](const pair<node_id, vector<size_t>>& g) { return g.first == graft_node; });
+            if (group != reassortment_groups.end()) {
+                group->second.push_back(seg);
+            } else {
+                reassortment_groups.push_back(make_pair(graft_node, vector<size_t>({seg})));
             }            
-            loop_count ++;            
-            opt_branch_matching_muts_count = 0;
-            matching_muts_opt_branch.clear();
-            conflicting_muts_opt_branch.clear();
-            no_muts_on_branch = false;
-            for (Node * child: search_node->children) {
-                if (debug) {
-                    cout << "child name is " << child->name << endl;
-                }                
-                child_branch_matching_muts_count = 0;
-                matching_muts_child_branch.clear();
-                conflicting_muts_child_branch.clear();
-                child->branch_mutations[seg].size() == 0 ? no_muts_on_branch = true : no_muts_on_branch = false;
-                // if (no_muts_on_branch == false) {
-                //     child->branch_mutations[seg].size() == 0 ? no_muts_on_branch = true : no_muts_on_branch = false;
-                // } else {
-                //     assert(child->branch_mutations[seg].size() > 0); // no_muts_on_branch should be true only for one child branch, not more
-                // }                
-                for (string mut: child->branch_mutations[seg]) {
-                    if (uniq_muts_in_sample.count(mut)) {
-                        matching_muts_child_branch.emplace(mut);
-                        child_branch_matching_muts_count ++;
-                    } else {
-                        conflicting_muts_child_branch.emplace(mut);
+        }
+        // If there are two groups and graft node of one group is parent of another then it is not reassortment. 
+        // If graft nodes are not parent-child then it is reassortment
+        if (reassortment_groups.size() == 2 && ancestry) { // classified by the index, which also tells ancestors further up
+            node_id first = reassortment_groups[0].first, second = reassortment_groups[1].first;
+            node_id common_ancestor = ancestry->lca(first, second);
+            if (common_ancestor == first || common_ancestor == second) {
+                node_id descendant = common_ancestor == first ? second : first;
+                size_t generations = ancestry->depth(descendant) - ancestry->depth(common_ancestor);
+                placement.parent_child = generations == 1;
+                placement.ancestral = generations > 1;
+            }
+            ENTWINE_LOG(LOG_DEBUG, "Lowest common ancestor of the graft nodes is " << (common_ancestor != NO_NODE ? node(common_ancestor).name : "none")
+                << (placement.parent_child ? ", they are parent and child" : placement.ancestral ? ", one descends from the other" : "") << endl);
+        } else if (reassortment_groups.size() == 2) {   
+            ENTWINE_LOG(LOG_DEBUG, "Two groups" << endl);
+            for (const auto& group1: reassortment_groups) {
+                for (const auto& group2: reassortment_groups) {
+                    if (node(group1.first).parent == group2.first || node(group2.first).parent == group1.first) {
+                        ENTWINE_LOG(LOG_DEBUG, "parent-child" << endl);
+                        if (group1.first != group2.first) {
+                            placement.parent_child = true;
+                            ENTWINE_LOG(LOG_DEBUG, "parent-child" << endl);
+                            // exit(-1);
+                        }                            
                     }
                 }
-                if (child_branch_matching_muts_count > opt_branch_matching_muts_count || no_muts_on_branch) {
-                    opt_branch_matching_muts_count = child_branch_matching_muts_count;
-                    matching_muts_opt_branch = matching_muts_child_branch;
-                    conflicting_muts_opt_branch = conflicting_muts_child_branch;
-                    opt_node = child;
+            }                
+        }
+    }
+
+    // Finds the child of search_node that the greedy descent moves to for segment seg, or NO_NODE if the descent stops at search_node.
+    // Scanning the children in order, the optimal child is the last one whose branch either has no mutations for seg or
+    // matches more of uniq_muts_in_sample than any child since the last such empty branch; the descent continues if the
+    // optimal branch matches at least one mutation or the last child's branch is empty.
+    // uniq_bits, if given, holds the same mutations as uniq_muts_in_sample and is used to count the matches.
+    // Children pruned for a sample dated latest_day (see is_pruned) are left out as if search_node did not have them.
+    node_id get_opt_child_for_seg(node_id search_node, size_t seg, const mut_set& uniq_muts_in_sample, vector<node_id>& matching_children, SegmentSearchStats * search_stats = nullptr, const MutationBitset * uniq_bits = nullptr, day_t latest_day = NO_DAY) const {
+        const Node& search = node(search_node);
+        if (use_subtree_summaries && !search.subtree_summary.may_contain_any(seg, uniq_muts_in_sample)) {
+            // no branch below matches, so every count is 0 and only the last child's branch decides
+            if (search_stats != nullptr) {
+                search_stats->summary_skips++;
+            }
+            int last = last_unpruned_child(search, latest_day);
+            return (last >= 0 && node(search.children[last]).branch_mutations[seg].empty()) ? search.children[last] : NO_NODE;
+        }
+        if (search.branch_index) {
+            return get_opt_child_for_seg_from_index(search_node, seg, uniq_muts_in_sample, matching_children, search_stats, latest_day);
+        }
+        if (search_stats != nullptr) {
+            search_stats->children_scanned += search.children.size();
+            search_stats->set_operations += search.children.size();
+        }
+        node_id opt_node = NO_NODE;
+        bool no_muts_on_branch = false;
+        size_t opt_branch_matching_muts_count = 0;
+        for (node_id child: search.children) {
+            if (is_pruned(child, latest_day)) {
+                if (search_stats != nullptr) {
+                    search_stats->temporal_prunes++;
+                }
+                continue;
+            }
+            const mut_set& child_branch_muts = node(child).branch_mutations[seg];
+            no_muts_on_branch = child_branch_muts.empty();
+            size_t child_branch_matching_muts_count = uniq_bits != nullptr ? uniq_bits->count_common(child_branch_muts) : count_common_muts(child_branch_muts, uniq_muts_in_sample);
+            if (child_branch_matching_muts_count > opt_branch_matching_muts_count || no_muts_on_branch) {
+                opt_branch_matching_muts_count = child_branch_matching_muts_count;
+                opt_node = child;
+            }
+        }
+        return (opt_branch_matching_muts_count > 0 || no_muts_on_branch) ? opt_node : NO_NODE;
+    }
+
+    // Whether temporal pruning leaves child out of the search for a sample dated latest_day: every dated node
+    // below child is later than the sample. Nothing is pruned for NO_DAY, which stands for no pruning or no date.
+    bool is_pruned(node_id child, day_t latest_day) const {
+        day_t min_day = node(child).subtree_min_day;
+        return latest_day != NO_DAY && min_day != NO_DAY && min_day > latest_day;
+    }
+
+    // Position of the last child of search that is not pruned, or -1 if there is none
+    int last_unpruned_child(const Node& search, day_t latest_day) const {
+        int last = static_cast<int>(search.children.size()) - 1;
+        while (last >= 0 && is_pruned(search.children[last], latest_day)) {
+            last--;
+        }
+        return last;
+    }
+
+    // Same choice as the scan in get_opt_child_for_seg, but matching counts come from the branch index of search_node,
+    // so only children that share a mutation with the sample are visited
+    node_id get_opt_child_for_seg_from_index(node_id search_node, size_t seg, const mut_set& uniq_muts_in_sample, vector<node_id>& matching_children, SegmentSearchStats * search_stats = nullptr, day_t latest_day = NO_DAY) const {
+        const Node& search = node(search_node);
+        matching_children.clear();
+        for (mut_id mut: uniq_muts_in_sample) {
+            const vector<node_id> * carriers = search.branch_index->children_with(seg, mut);
+            if (carriers != nullptr) {
+                matching_children.insert(matching_children.end(), carriers->begin(), carriers->end());
+            }
+        }
+        sort(matching_children.begin(), matching_children.end());
+        if (search_stats != nullptr) {
+            search_stats->index_lookups += uniq_muts_in_sample.size();
+            search_stats->children_scanned += matching_children.size();
+        }
+        int last_empty = search.last_empty_child[seg];
+        if (latest_day != NO_DAY) { // the last empty branch among the children that are not pruned
+            while (last_empty >= 0 && (is_pruned(search.children[last_empty], latest_day) || !node(search.children[last_empty]).branch_mutations[seg].empty())) {
+                last_empty--;
+            }
+        }
+        node_id opt_node = NO_NODE;
+        size_t opt_child_index = 0;
+        size_t opt_branch_matching_muts_count = 0;
+        for (size_t i = 0; i < matching_children.size();) {
+            node_id child = matching_children[i];
+            size_t child_branch_matching_muts_count = 0;
+            for (; i < matching_children.size() && matching_children[i] == child; i++) {
+                child_branch_matching_muts_count++;
+            }
+            size_t child_index = node(child).child_index;
+            if (static_cast<int>(child_index) <= last_empty) {
+                continue; // the empty branch after it resets the optimum
+            }
+            if (is_pruned(child, latest_day)) {
+                if (search_stats != nullptr) {
+                    search_stats->temporal_prunes++;
                 }
+                continue;
+            }
+            if (child_branch_matching_muts_count > opt_branch_matching_muts_count ||
+                (child_branch_matching_muts_count == opt_branch_matching_muts_count && child_index < opt_child_index)) {
+                opt_branch_matching_muts_count = child_branch_matching_muts_count;
+                opt_node = child;
+                opt_child_index = child_index;
             }
-            if (opt_branch_matching_muts_count > 0 || no_muts_on_branch) {
-                // cout << "search node is " << search_node->in_degree << " for segment " << seg << endl;
+        }
+        if (opt_node != NO_NODE) {
+            return opt_node;
+        }
+        if (last_empty >= 0 && last_empty == last_unpruned_child(search, latest_day)) {
+            return search.children[last_empty]; // no_muts_on_branch
+        }
+        return NO_NODE;
+    }
+
+    // positions that are shared by uniq_muts_in_sample and conflicting_muts_in_opt_path may be reversions or sign of reassortment/recombination
+    // search_stats, if given, receives the depth and work of this search
+    tuple <node_id, mut_set, mut_set> get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(node_id sample_node, size_t seg, SegmentSearchStats * search_stats = nullptr) const {
+        return get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(sample_genotype(sample_node, seg), node(sample_node).name, seg, search_stats, nullptr, parse_day(node(sample_node).date, true));
+    }
+
+    // Same search for mutations of a sample that need not be in the network. If trace is given, the nodes whose
+    // children were examined are recorded in it, and exceeding the loop limit is reported there instead of exiting.
+    // sample_day, the latest day the sample's date may stand for, is used for temporal pruning if it is enabled.
+    tuple <node_id, mut_set, mut_set> get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(const mut_set& sample_muts, const string& sample_name, size_t seg, SegmentSearchStats * search_stats = nullptr, SearchTrace * trace = nullptr, day_t sample_day = NO_DAY) const {
+        node_id search_node = root;
+        mut_set uniq_muts_in_sample = sample_muts;
+        mut_set conflicting_muts_opt_path;
+        // scratch buffers, reused by every search on this thread
+        static thread_local mut_set matching_muts_opt_branch;
+        static thread_local mut_set conflicting_muts_opt_branch;
+        static thread_local vector<node_id> matching_children;
+        // dense samples are matched against a bitset of their unique mutations, cleared again before returning
+        static thread_local MutationBitset uniq_bits;
+        bool use_bits = uniq_muts_in_sample.size() >= MUTATION_BITSET_MIN_MUTS;
+        if (use_bits) {
+            uniq_bits.reserve_ids(max<size_t>(mut_id_bound, uniq_muts_in_sample.back() + 1));
+            uniq_bits.insert(uniq_muts_in_sample);
+        }
+        day_t latest_day = use_temporal_pruning ? sample_day : NO_DAY;
+        bool left_segment_tree = false; // descended into a reassortment node through a parent seg is not inherited from
+        size_t loop_count = 0;
+        size_t depth_limit = search_depth_limit();
+        while (true) {
+            ENTWINE_LOG(LOG_DEBUG, "search node is " << node(search_node).name << " for segment " << seg_names[seg] << endl);
+            loop_count ++;            
+            if (trace != nullptr) {
+                trace->path.push_back(search_node);
+            }
+            node_id opt_node = get_opt_child_for_seg(search_node, seg, uniq_muts_in_sample, matching_children, search_stats, use_bits ? &uniq_bits : nullptr, latest_day);
+            if (opt_node != NO_NODE) {
+                left_segment_tree = left_segment_tree || (node(opt_node).reassortment_node && parent_for_seg(node(opt_node), seg) != search_node);
                 search_node = opt_node;
-                assert(search_node != 0);
-                // cout << "opt node is " << opt_node->name << " for segment " << seg << endl;
-                for (string mut: matching_muts_opt_branch) {
-                    uniq_muts_in_sample.erase(mut);
-                }
-                for (string mut: conflicting_muts_opt_branch) {
-                    conflicting_muts_opt_path.emplace(mut);
-                }                
-            } else {
-                continue_search = false;
-                graft_node = search_node;
-            }
-            if (loop_count > 100) {                
-                cout << "Network size is " << nodes.size() << endl;
-                cout << "Attempting to graft " << sample_node->name << " for segment " << seg << endl;
-                cout << "Search node is " << search_node->name << " for segment " << seg << endl;
-                cout << "Optimum branch matching muts count is " << opt_branch_matching_muts_count << endl;
-                cerr << "Error: Loop count exceeded 100" << endl;
+                // matching mutations are explained by the opt branch, the rest of the branch conflicts with the sample
+                if (use_bits) {
+                    uniq_bits.split(node(search_node).branch_mutations[seg], matching_muts_opt_branch, conflicting_muts_opt_branch);
+                    uniq_bits.erase(matching_muts_opt_branch);
+                } else {
+                    split_muts(node(search_node).branch_mutations[seg], uniq_muts_in_sample, matching_muts_opt_branch, conflicting_muts_opt_branch);
+                }
+                subtract_muts(uniq_muts_in_sample, matching_muts_opt_branch);
+                unite_muts(conflicting_muts_opt_path, conflicting_muts_opt_branch);
+                if (search_stats != nullptr) {
+                    search_stats->set_operations += 3;
+                }
+            }
+            if (loop_count > depth_limit && trace != nullptr) {
+                trace->exceeded_loop_limit = true;
+                break;
+            }
+            if (loop_count > depth_limit && search_failures_allowed) {
+                ENTWINE_LOG(LOG_INFO, "Search for " << sample_name << " passed the depth limit of " << depth_limit << " for segment " << seg_names[seg] << endl);
+                if (use_bits) {
+                    uniq_bits.erase(uniq_muts_in_sample);
+                }
+                return make_tuple(NO_NODE, mut_set(), mut_set());
+            }
+            if (loop_count > depth_limit) {
+                cerr << "Network size is " << nodes.size() << endl;
+                cerr << "Attempting to graft " << sample_name << " for segment " << seg_names[seg] << endl;
+                cerr << "Search node is " << node(search_node).name << " for segment " << seg_names[seg] << endl;
+                cerr << "Optimum branch matching muts count is " << matching_muts_opt_branch.size() << endl;
+                cerr << "Error: Loop count exceeded " << depth_limit << endl;
                 exit(-1);
             }
+            if (opt_node == NO_NODE) {
+                break;
+            }
+        }
+        if (use_bits) {
+            uniq_bits.erase(uniq_muts_in_sample);
+        }
+        if (left_segment_tree || (node(search_node).reassortment_node && parent_for_seg(node(search_node), seg) != node(search_node).parent)) {
+            restore_off_path_mutations(search_node, seg, sample_muts, conflicting_muts_opt_path, uniq_muts_in_sample, search_stats);
         }
-        return(make_tuple(graft_node,uniq_muts_in_sample,conflicting_muts_opt_path));
+        if (search_stats != nullptr) {
+            search_stats->add_search(loop_count - 1);
+        }
+        return(make_tuple(search_node, move(uniq_muts_in_sample), move(conflicting_muts_opt_path)));
     }
 
-    // Function to load mutations from a CSV file
-    void read_mutations_from_file() {
-        ifstream file(mutations_file_name);
-        if (!file) {
-            cerr << "Error: Could not open file " << mutations_file_name << endl;
-            return;
+    // A search that descends into a reassortment node through a parent other than its parent for seg matches
+    // mutations off the tree of seg, and a sample grafted at a reassortment node hangs off its first parent,
+    // which need not be its parent for seg either. So the sample mutations the search matched are not all on
+    // the path of the parent the sample is grafted below: the path to Node::parent(graft_node) and the part of
+    // the graft node's branch that stays above the split, see apply_placement. Those that are not are added to
+    // uniq_muts_in_sample and so end up on the sample's own branch. Paths through reassortment nodes are long,
+    // so the path is taken from the genotype cache rather than walked every time.
+    void restore_off_path_mutations(node_id graft_node, size_t seg, const mut_set& sample_muts, const mut_set& conflicting_muts_opt_path, mut_set& uniq_muts_in_sample, SegmentSearchStats * search_stats) const {
+        mut_set off_path = sample_muts;
+        subtract_muts(off_path, uniq_muts_in_sample);
+        mut_set graft_branch_uniq_muts, graft_branch_common_muts;
+        split_muts(node(graft_node).branch_mutations[seg], conflicting_muts_opt_path, graft_branch_uniq_muts, graft_branch_common_muts);
+        subtract_muts(off_path, graft_branch_common_muts);
+        if (!off_path.empty()) {
+            subtract_muts(off_path, path_mutations(node(graft_node).parent, seg));
+        }
+        if (search_stats != nullptr) {
+            search_stats->mutations_restored += off_path.size();
         }
+        unite_muts(uniq_muts_in_sample, off_path);
+    }
 
-        string line;
-        bool firstLine = true;
-        int lines_parsed = 0;
-        unsigned long num_columns = 10;
+    // Grafts the samples of read_mutations_from_file in this order from now on (--order)
+    void set_sample_order(SampleOrder order) {
+        sample_order = order;
+    }
 
-        while (getline(file, line)) {
-            lines_parsed +=1 ;
-            cout << "Parsing line " << lines_parsed << endl;
-            istringstream ss(line);
-            string token;
-            vector<string> tokens;
+    // Steps a graft search may descend before it is taken to be lost. In file order samples come roughly in
+    // the order they were sampled and the networks stay shallow, so the original limit of 100 holds. Other
+    // orders graft long chains of descendants, such as samples sorted by their number of mutations, so there
+    // a search is only bounded by the network: each step descends, and a descent through more nodes than the
+    // network has must be going round a loop.
+    size_t search_depth_limit() const {
+        return sample_order == SampleOrder::file ? 100 : nodes.size();
+    }
 
-            // Tokenize line by ","
-            while (getline(ss, token, ',')) {
-                tokens.push_back(trim(token));  // Remove whitespace
+    // Function to load mutations from a CSV file ("-" for stdin) and graft the samples in file order, or in the
+    // order set by set_sample_order. On a network loaded from a snapshot only the samples it does not contain
+    // yet are grafted. With a compact interval set, the network is compacted during grafting and once at the end.
+    // In file order a parser thread reads and decodes the file a block at a time while this thread grafts the
+    // samples of earlier blocks; at most SAMPLE_QUEUE_BLOCKS decoded blocks wait between the two, which bounds
+    // memory when the input is a pipe. The parser interns mutations, so grafting must not read mutation_dict
+    // meanwhile. Any other order needs all samples before the first graft, so the whole file is loaded first.
+    void read_mutations_from_file(const string& file_name) {
+        static const size_t SAMPLE_QUEUE_BLOCKS = 4;
+        size_t num_skipped = stats.samples_skipped;
+        if (sample_order != SampleOrder::file) {
+            SampleTable samples;
+            if (!load_samples(file_name == "-" ? "/dev/stdin" : file_name, samples)) {
+                return;
             }
+            auto start = chrono::steady_clock::now();
+            samples.reorder(order_samples(samples, sample_order));
+            stats.order_seconds += NetworkStats::seconds_since(start);
+            graft_samples(samples);
+        } else {
+            SampleStream stream;
+            vector<string> file_seg_names;
+            if (!stream.open(file_name) || !stream.read_header(file_seg_names) || !use_segments(file_name, file_seg_names)) {
+                return;
+            }
+            double parse_seconds = 0;
+            BoundedQueue<unique_ptr<SampleTable>> blocks(SAMPLE_QUEUE_BLOCKS);
+            thread parser([&]() {
+                while (true) {
+                    auto start = chrono::steady_clock::now();
+                    unique_ptr<SampleTable> block = stream.next_block(file_seg_names, *thread_pool, mutation_dict);
+                    parse_seconds += NetworkStats::seconds_since(start);
+                    if (!block) {
+                        break;
+                    }
+                    blocks.push(move(block));
+                }
+                blocks.close();
+            });
+            unique_ptr<SampleTable> block;
+            while (blocks.pop(block)) {
+                graft_samples(*block);
+            }
+            parser.join();
+            stats.parse_seconds += parse_seconds;
+        }
+        stats.sample_order = sample_order_name(sample_order);
+        if (compact_interval > 0) { // the written network is compact whatever the interval
+            compact();
+        }
+        num_skipped = stats.samples_skipped - num_skipped;
+        if (num_skipped > 0) {
+            ENTWINE_LOG(LOG_INFO, "Skipped " << num_skipped << " samples already in the network" << endl);
+        }
+    }
+
+    // Loads the samples of a mutations CSV into samples, see use_segments
+    bool load_samples(const string& file_name, SampleTable& samples) {
+        auto start = chrono::steady_clock::now();
+        if (!samples.load(file_name, *thread_pool, mutation_dict) || !use_segments(file_name, samples.seg_names())) {
+            return false;
+        }
+        stats.parse_seconds += NetworkStats::seconds_since(start);
+        return true;
+    }
+
+    // Takes the segments listed in the header of a mutations CSV. A new network takes its segments from
+    // the header and creates root; an existing network requires the header to list its segments.
+    bool use_segments(const string& file_name, const vector<string>& file_seg_names) {
+        if (root != NO_NODE && file_seg_names != seg_names) {
+            cerr << "Error: Segments in the header of " << file_name << " do not match the segments of the network:";
+            for (const string& seg_name: seg_names) {
+                cerr << " " << seg_name;
+            } cerr << endl;
+            return false;
+        }
+        seg_names = file_seg_names;
+        genotype_cache.reset(seg_names.size(), GENOTYPE_CACHE_MUTS); // the cache only holds copies, emptying it is always safe
+        if (stats.segments.size() != seg_names.size()) {
+            stats.segments.assign(seg_names.size(), SegmentSearchStats());
+        }
+        if (ENTWINE_LOG_ENABLED(LOG_INFO)) {
+            for (const string& seg_name: seg_names) {
+                cout << seg_name << "\t";
+            } cout << endl;
+        }
+        if (root == NO_NODE) {
+            create_root();
+        }
+        return true;
+    }
 
-            if (firstLine) {                
-                seg_names.clear();
-                seg_names.assign(tokens.begin()+2, tokens.end()); // Store segment names from header (excluding Date and ID columns)                
-                // cout << "Segment names in mutation file are" << endl;
-                for (string seg_name: seg_names) {
-                    cout << seg_name << "\t";
-                } cout << endl;
-                firstLine = false;
+    // Grafts the samples loaded by load_samples in table order, skipping samples already in the network
+    void graft_samples(const SampleTable& samples) {
+        vector<mut_set> mutations;
+        size_t num_skipped = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            if (compact_interval > 0 && stats.samples_grafted - samples_at_compaction >= compact_interval) {
+                compact();
+            }
+            if (batch_size > 1 && nodes.size() > 1) {
+                size_t batch_end = min(samples.size(), i + batch_size);
+                if (compact_interval > 0) { // end the batch where grafting one by one would compact next
+                    batch_end = min(batch_end, i + compact_interval - (stats.samples_grafted - samples_at_compaction));
+                }
+                graft_batch(samples, i, batch_end, num_skipped);
+                i = batch_end - 1;
+                continue;
+            }
+            string sample_name(samples.id(i));
+            if (get_node(sample_name) != NO_NODE) {
+                ENTWINE_LOG(LOG_VERBOSE, "Skipping " << sample_name << ", already in the network" << endl);
+                num_skipped++;
                 continue;
             }
-            
-            assert(tokens.size() == num_columns);
-            // if (tokens.size() < 2) continue; // Skip invalid lines
+            string date(samples.date(i));
+            samples.get_mutations(i, mutations);
+            ENTWINE_LOG(LOG_VERBOSE, "Grafting " << sample_name << endl);
+            if (nodes.size() == 1) { // only root
+                graft_at_root(sample_name, date, mutations);
+            } else {
+                graft_sample(move(sample_name), move(date), move(mutations));
+            }        
+        }
+        stats.samples_skipped += num_skipped;
+    }
+
+    // Grafts samples [first, last) with exactly the result of grafting them one by one (--batch).
+    // All segments of all samples are first searched in parallel against the network as it is. Then, in
+    // sample order, a search is repeated if its path went through a node changed by an earlier sample of
+    // the batch, and the sample is grafted. A search reads nothing but the nodes on its path and their
+    // children, and grafting changes only the graft nodes and their parents, so a path that avoids every
+    // changed node makes the same choices as a search made after the earlier grafts.
+    void graft_batch(const SampleTable& samples, size_t first, size_t last, size_t& num_skipped) {
+        auto start = chrono::steady_clock::now();
+        size_t num_segs = seg_names.size();
+        size_t batch = last - first;
+        vector<vector<mut_set>> batch_mutations(batch);
+        vector<Placement> placements(batch);
+        vector<vector<SearchTrace>> traces(batch, vector<SearchTrace>(num_segs));
+        vector<vector<SegmentSearchStats>> batch_stats(batch, vector<SegmentSearchStats>(num_segs));
+        thread_pool->parallel_for(batch, [&](size_t j) {
+            samples.get_mutations(first + j, batch_mutations[j]);
+            string sample_name(samples.id(first + j));
+            day_t sample_day = parse_day(samples.date(first + j), true);
+            placements[j].graft_info.resize(num_segs);
+            for (size_t seg = 0; seg < num_segs; seg++) {
+                placements[j].graft_info[seg] = get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(batch_mutations[j][seg], sample_name, seg, &batch_stats[j][seg], &traces[j][seg], sample_day);
+            }
+        });
+        stats.search_seconds += NetworkStats::seconds_since(start);
 
-            string date = trim(tokens[0]);
-            string node_id = trim(tokens[1]);
-            map<string, set<string>> mutations;
+        batch_epoch++;
+        auto changed = [&](node_id id) { return id < changed_in_batch.size() && changed_in_batch[id] == batch_epoch; };
+        auto mark_changed = [&](node_id id) {
+            if (id >= changed_in_batch.size()) {
+                changed_in_batch.resize(nodes.capacity(), 0);
+            }
+            changed_in_batch[id] = batch_epoch;
+        };
+        for (size_t j = 0; j < batch; j++) {
+            string sample_name(samples.id(first + j));
+            if (get_node(sample_name) != NO_NODE) {
+                ENTWINE_LOG(LOG_VERBOSE, "Skipping " << sample_name << ", already in the network" << endl);
+                num_skipped++;
+                continue;
+            }
+            ENTWINE_LOG(LOG_VERBOSE, "Grafting " << sample_name << endl);
+            auto commit_start = chrono::steady_clock::now();
+            Placement& placement = placements[j];
+            day_t sample_day = parse_day(samples.date(first + j), true);
+            for (size_t seg = 0; seg < num_segs; seg++) {
+                stats.segments[seg].merge(batch_stats[j][seg]);
+                const SearchTrace& trace = traces[j][seg];
+                if (trace.exceeded_loop_limit || any_of(trace.path.begin(), trace.path.end(), changed)) {
+                    placement.graft_info[seg] = get_1_graft_node_2_uniq_muts_in_sample_3_conflicting_muts_in_opt_path_for_seg(batch_mutations[j][seg], sample_name, seg, &stats.segments[seg], nullptr, sample_day);
+                    stats.batch_searches_repeated++;
+                }
+            }
+            if (any_of(placement.graft_info.begin(), placement.graft_info.end(), [](const tuple<node_id, mut_set, mut_set>& info) { return get<0>(info) == NO_NODE; })) {
+                cerr << "Error: Could not graft " << sample_name << ", its search passed the depth limit" << endl;
+                continue;
+            }
+            group_placement(placement, batch_mutations[j]);
+            auto searched = chrono::steady_clock::now();
+            stats.search_seconds += chrono::duration<double>(searched - commit_start).count();
 
-            // Parse mutations for each segment
-            for (size_t i = 2; i < num_columns; i++) {
-                istringstream mutationStream(tokens[i]);
-                string mutation;
-                set<string> mutationSet;
-                // Tokenize mutations by ":"
-                while (getline(mutationStream, mutation, ':')) {
-                    mutationSet.insert(trim(mutation));  // Remove whitespace
+            node_id sample = add_node(sample_name, string(samples.date(first + j)), move(batch_mutations[j]));
+            if (placement.reassortment_groups.size() == 1 || !placement.parent_child) {
+                for (const auto& group: placement.reassortment_groups) {
+                    mark_changed(group.first);
+                    if (node(group.first).parent != NO_NODE) {
+                        mark_changed(node(group.first).parent);
+                    }
+                }
+            }
+            record_lowered_days = use_temporal_pruning;
+            apply_placement(sample, placement);
+            record_lowered_days = false;
+            // pruning reads the earliest day below each child, so the parents of nodes whose day fell have changed
+            for (node_id lowered: lowered_days) {
+                mark_changed(lowered);
+                if (node(lowered).parent != NO_NODE) {
+                    mark_changed(node(lowered).parent);
                 }
-                if ((i - 2) < seg_names.size()) {
-                    mutations[seg_names[i - 2]] = mutationSet; // Map mutations to correct segment
+                for (node_id above: node(lowered).parent4seg) {
+                    if (above != NO_NODE) {
+                        mark_changed(above);
+                    }
                 }
             }
-            if (lines_parsed == 2) {
-                cout << "Grafting " << node_id << endl;
-                graft_at_root(node_id, date, mutations);
-            } else {
-                cout << "Grafting " << node_id << endl;
-                graft_sample(node_id, date, mutations);
-            }        
+            lowered_days.clear();
+            stats.graft_seconds += NetworkStats::seconds_since(searched);
+            stats.samples_grafted++;
+        }
+    }
+
+    // Places the samples of a mutations CSV without grafting them (--place). Samples are placed in parallel
+    // against the network as it is and written to out as one tab-separated row per sample and segment.
+    void place_samples_from_file(const string& file_name, ostream& out) {
+        SampleTable samples;
+        if (root == NO_NODE) {
+            cerr << "Error: Samples can only be placed on a built network" << endl;
+            return;
+        }
+        if (!load_samples(file_name, samples)) {
+            return;
+        }
+        auto start = chrono::steady_clock::now();
+        const size_t block_size = 64;
+        vector<string> rows((samples.size() + block_size - 1) / block_size);
+        const Network& network = *this; // placement never changes the network
+        thread_pool->parallel_for(rows.size(), [&](size_t block) {
+            ostringstream block_rows;
+            vector<mut_set> mutations;
+            for (size_t i = block * block_size; i < min(samples.size(), (block + 1) * block_size); i++) {
+                string sample_name(samples.id(i));
+                samples.get_mutations(i, mutations);
+                network.write_placement(block_rows, sample_name, network.place_sample(mutations, sample_name, false, nullptr, parse_day(samples.date(i), true)));
+            }
+            rows[block] = block_rows.str();
+        });
+        out << "ID\tSegment\tGraftNode\tGraftParent\tUniqueMutations\tConflictingMutations\tGroup\tPlacement\n";
+        for (const string& block_rows: rows) {
+            out << block_rows;
         }
-        file.close();
+        stats.place_seconds += NetworkStats::seconds_since(start);
+        stats.samples_placed += samples.size();
     }
+
+    // Writes placement as rows of the --place table. Placement is reassortment, parent-child (two graft nodes that are
+    // parent and child, where graft_sample adds nothing), root (child of root) or branch (on the branch above GraftNode).
+    // query_names names the mutation IDs past the dictionary, see MutationDictionary::write_names.
+    void write_placement(ostream& out, const string& sample_name, const Placement& placement, const vector<string>& query_names = {}) const {
+        string kind;
+        if (placement.reassortment_groups.size() > 1) {
+            kind = placement.parent_child ? "parent-child" : "reassortment";
+        } else {
+            kind = placement.reassortment_groups[0].first == root ? "root" : "branch";
+        }
+        for (size_t group = 0; group < placement.reassortment_groups.size(); group++) {
+            for (size_t seg: placement.reassortment_groups[group].second) {
+                node_id graft_node = get<0>(placement.graft_info[seg]);
+                const Node& graft = node(graft_node);
+                out << sample_name << "\t" << seg_names[seg] << "\t" << graft.name << "\t" << (graft.parent != NO_NODE ? node(graft.parent).name : "") << "\t";
+                mutation_dict.write_names(out, get<1>(placement.graft_info[seg]), ":", query_names);
+                out << "\t";
+                mutation_dict.write_names(out, get<2>(placement.graft_info[seg]), ":", query_names);
+                out << "\t" << group + 1 << "\t" << kind << "\n";
+            }
+        }
+    }
+
+    size_t num_nodes() const { return nodes.size(); }
+    // Live nodes have handles below node_capacity(); is_live tells which of them are
+    node_id node_capacity() const { return nodes.capacity(); }
+    bool is_live(node_id id) const { return nodes.is_live(id); }
+    size_t num_segments() const { return seg_names.size(); }
 };
 
 #endif // NETWORK_H
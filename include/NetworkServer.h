@@ -0,0 +1,445 @@
+#ifndef NETWORK_SERVER_H
+#define NETWORK_SERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Network.h"
+
+using namespace std;
+
+// Keeps a network in memory and answers requests about it, one per line, on stdin and stdout (--serve) or
+// on every connection to a Unix domain socket (--serve --socket <path>), so that samples can be grafted and
+// looked up without loading the network again for each. Requests:
+//   header Date,ID,<segment>,...  segments of a new network, before its first graft
+//   graft <row>                   grafts a sample given as a row of a mutations CSV; answers its name and parent
+//   place <row>                   where the sample would be grafted, as rows of the --place table
+//   node <name>                   name, kind and date of a node, then per segment its parent and mutations
+//   stats                         the --stats JSON
+//   snapshot <file>               saves a snapshot of the network
+//   quit                          closes the connection; shutdown also stops a socket server
+// Every answer is "ok N" followed by N lines, or "error <message>". Requests may be sent without waiting for
+// answers, which come back in request order. Queries (place, node, stats, snapshot) only read the network and
+// run concurrently on a pool of threads, alongside those of other connections; header and graft change it, so
+// they wait for the earlier queries of their connection and then run alone. With --compact, a snapshot first
+// compacts the samples grafted since the last compaction, running alone while it does.
+class NetworkServer {
+private:
+    struct Answer {
+        string text;
+        bool done = false;
+    };
+
+    // Answers of one connection, written out in request order as they are done
+    struct Connection {
+        int out_fd = -1;
+        mutex lock;
+        condition_variable changed;
+        deque<shared_ptr<Answer>> pending;
+        size_t queries_running = 0;
+        bool closed = false; // no more requests
+    };
+
+    Network& network;
+    shared_mutex network_lock; // shared by queries, held alone by header and graft
+    mutex stats_lock; // queries count placements in the network stats while they share the network
+    ThreadPool query_pool;
+    ThreadPool row_pool{1}; // parses single rows inline
+    mutex connections_lock;
+    unordered_set<int> connection_fds; // open connections of a socket server
+    bool stopping = false; // set by shutdown, under connections_lock
+
+    static string ok(const string& lines) {
+        return "ok " + to_string(count(lines.begin(), lines.end(), '\n')) + "\n" + lines;
+    }
+
+    static string error(const string& message) {
+        return "error " + message + "\n";
+    }
+
+    static bool write_all(int fd, const string& text) {
+        for (size_t written = 0; written < text.size();) {
+            ssize_t n = write(fd, text.data() + written, text.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            written += n;
+        }
+        return true;
+    }
+
+    // Reads the next line from fd into line, without its line ending; buffer keeps what was read past it
+    static bool read_line(int fd, string& buffer, string& line) {
+        size_t newline;
+        while ((newline = buffer.find('\n')) == string::npos) {
+            char chunk[1 << 16];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                if (buffer.empty()) {
+                    return false;
+                }
+                newline = buffer.size();
+                buffer.push_back('\n');
+                break;
+            }
+            buffer.append(chunk, n);
+        }
+        line.assign(buffer, 0, newline);
+        buffer.erase(0, newline + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        return true;
+    }
+
+    // Checks that row has the columns of a sample row of the network's mutations CSV
+    bool check_row(const string& row, string& message) const {
+        size_t num_columns = network.get_seg_names().size() + 2;
+        size_t columns = count(row.begin(), row.end(), ',') + 1;
+        if (columns < 2 || columns > num_columns) {
+            message = "row has " + to_string(columns) + " columns, expected " + to_string(num_columns);
+            return false;
+        }
+        return true;
+    }
+
+    string answer_header(const string& header) {
+        vector<string> names = SampleTable::parse_header(header);
+        if (names.empty()) {
+            return error("header lists no segments");
+        }
+        unique_lock<shared_mutex> guard(network_lock);
+        if (network.get_root() != NO_NODE && names != network.get_seg_names()) {
+            return error("segments do not match the segments of the network");
+        }
+        network.use_segments("header", names);
+        return ok("");
+    }
+
+    string answer_graft(const string& row) {
+        unique_lock<shared_mutex> guard(network_lock);
+        string message;
+        if (network.get_root() == NO_NODE) {
+            return error("no segments yet, send a header first");
+        }
+        if (!check_row(row, message)) {
+            return error(message);
+        }
+        SampleTable sample;
+        sample.load_lines(row, network.get_seg_names(), 0, row_pool, network.get_mutation_dict());
+        string sample_name(sample.id(0));
+        if (sample_name.empty()) {
+            return error("row has no ID");
+        }
+        if (network.get_node(sample_name) != NO_NODE) {
+            return error(sample_name + " is already in the network");
+        }
+        network.graft_samples(sample);
+        node_id id = network.get_node(sample_name);
+        if (id == NO_NODE) {
+            return error("could not graft " + sample_name + ", its search passed the depth limit");
+        }
+        node_id parent = network.node(id).parent;
+        return ok(sample_name + "\t" + (parent != NO_NODE ? network.node(parent).name : "") + "\n");
+    }
+
+    // Places row on the network, which the caller holds shared. Mutations the network does not have get IDs
+    // of the query alone, past the end of the dictionary: they match no branch, and the dictionary is left as
+    // it is for the queries running alongside and for later snapshots.
+    bool place_row(const string& row, string& rows, string& message) {
+        auto start = chrono::steady_clock::now();
+        if (network.get_root() == NO_NODE) {
+            message = "no network to place on";
+            return false;
+        }
+        if (!check_row(row, message)) {
+            return false;
+        }
+        SampleTable sample;
+        MutationDictionary row_dict;
+        sample.load_lines(row, network.get_seg_names(), 0, row_pool, row_dict);
+        vector<mut_set> mutations;
+        sample.get_mutations(0, mutations);
+        const MutationDictionary& mutation_dict = network.get_mutation_dict();
+        vector<string> query_names; // of the IDs from mutation_dict.size() on
+        vector<mut_id> query_ids(row_dict.size(), NO_MUTATION); // by row_dict ID
+        for (mut_set& muts: mutations) {
+            for (mut_id& mut: muts) {
+                mut_id row_mut = mut;
+                mut = mutation_dict.find(row_dict.name(row_mut));
+                if (mut == NO_MUTATION) {
+                    if (query_ids[row_mut] == NO_MUTATION) {
+                        query_ids[row_mut] = static_cast<mut_id>(mutation_dict.size() + query_names.size());
+                        query_names.push_back(row_dict.name(row_mut));
+                    }
+                    mut = query_ids[row_mut];
+                }
+            }
+            sort(muts.begin(), muts.end());
+        }
+        string sample_name(sample.id(0));
+        Placement placement = network.place_sample(mutations, sample_name, false, nullptr, parse_day(sample.date(0), true));
+        if (placement.search_failed) {
+            message = "the search for " + sample_name + " passed the depth limit";
+            return false;
+        }
+        ostringstream out;
+        network.write_placement(out, sample_name, placement, query_names);
+        rows = out.str();
+        lock_guard<mutex> stats_guard(stats_lock);
+        network.add_placements(1, NetworkStats::seconds_since(start));
+        return true;
+    }
+
+    string answer_place(const string& row) {
+        string rows, message;
+        shared_lock<shared_mutex> guard(network_lock);
+        return place_row(row, rows, message) ? ok(rows) : error(message);
+    }
+
+    string answer_node(const string& name) {
+        shared_lock<shared_mutex> guard(network_lock);
+        node_id id = network.get_node(name);
+        if (id == NO_NODE) {
+            return error("no node named " + name);
+        }
+        const Node& n = network.node(id);
+        const vector<string>& seg_names = network.get_seg_names();
+        ostringstream out;
+        string kind = id == network.get_root() ? "root" : n.reassortment_node ? "reassortment" : n.hidden_node ? "hidden" : "sample";
+        out << n.name << "\t" << kind << "\t" << (n.date.empty() && n.subtree_min_day != NO_DAY ? format_day(n.subtree_min_day) + " (inferred)" : n.date) << "\n";
+        for (size_t seg = 0; seg < seg_names.size(); seg++) {
+            node_id parent = network.parent_for_seg(n, seg);
+            out << seg_names[seg] << "\t" << (parent != NO_NODE ? network.node(parent).name : "") << "\t";
+            network.get_mutation_dict().write_names(out, network.sample_genotype(id, seg), ":");
+            out << "\n";
+        }
+        return ok(out.str());
+    }
+
+    string answer_stats() {
+        shared_lock<shared_mutex> guard(network_lock);
+        lock_guard<mutex> stats_guard(stats_lock);
+        ostringstream out;
+        network.write_stats(out);
+        return ok(out.str());
+    }
+
+    // Saves a snapshot, after the compaction --compact leaves pending, which needs the network alone
+    string answer_snapshot(const string& file_name) {
+        shared_lock<shared_mutex> guard(network_lock);
+        unique_lock<shared_mutex> exclusive(network_lock, defer_lock);
+        if (network.compaction_pending()) {
+            guard.unlock();
+            exclusive.lock();
+            if (network.compaction_pending()) { // unless a graft ran in between and compacted
+                network.compact();
+            }
+        }
+        if (file_name.empty() || !network.save_snapshot(file_name)) {
+            return error("could not write snapshot " + file_name);
+        }
+        return ok("");
+    }
+
+    string answer_query(const string& command, const string& argument) {
+        if (command == "place") {
+            return answer_place(argument);
+        } else if (command == "node") {
+            return answer_node(argument);
+        } else if (command == "stats") {
+            return answer_stats();
+        }
+        return answer_snapshot(argument);
+    }
+
+    static void finish(Connection& connection, const shared_ptr<Answer>& answer, string text, bool query) {
+        lock_guard<mutex> guard(connection.lock);
+        answer->text = move(text);
+        answer->done = true;
+        if (query) {
+            connection.queries_running--;
+        }
+        connection.changed.notify_all();
+    }
+
+    static void write_answers(Connection& connection) {
+        unique_lock<mutex> guard(connection.lock);
+        while (true) {
+            connection.changed.wait(guard, [&] { return (!connection.pending.empty() && connection.pending.front()->done) || (connection.closed && connection.pending.empty()); });
+            if (connection.pending.empty()) {
+                return;
+            }
+            shared_ptr<Answer> answer = move(connection.pending.front());
+            connection.pending.pop_front();
+            guard.unlock();
+            write_all(connection.out_fd, answer->text); // a client that went away still has its requests run
+            guard.lock();
+        }
+    }
+
+    // Answers the requests read from in_fd on out_fd until quit, shutdown or the end of input. Returns false after shutdown.
+    bool serve_connection(int in_fd, int out_fd) {
+        Connection connection;
+        connection.out_fd = out_fd;
+        thread writer([&connection]() { write_answers(connection); });
+        string buffer, line;
+        bool shutdown = false;
+        while (read_line(in_fd, buffer, line)) {
+            string_view request = trim_view(line);
+            if (request.empty()) {
+                continue;
+            }
+            size_t space = min(request.find(' '), request.size());
+            string command(request.substr(0, space));
+            string argument(trim_view(request.substr(space)));
+            shared_ptr<Answer> answer = make_shared<Answer>();
+            unique_lock<mutex> guard(connection.lock);
+            connection.pending.push_back(answer);
+            if (command == "place" || command == "node" || command == "stats" || command == "snapshot") {
+                connection.queries_running++;
+                guard.unlock();
+                query_pool.submit([this, &connection, answer, command, argument]() { finish(connection, answer, answer_query(command, argument), true); });
+                continue;
+            }
+            connection.changed.wait(guard, [&] { return connection.queries_running == 0; });
+            guard.unlock();
+            if (command == "quit" || command == "shutdown") {
+                shutdown = command == "shutdown";
+                finish(connection, answer, ok(""), false);
+                break;
+            } else if (command == "header") {
+                finish(connection, answer, answer_header(argument), false);
+            } else if (command == "graft") {
+                finish(connection, answer, answer_graft(argument), false);
+            } else {
+                finish(connection, answer, error("unknown request " + command), false);
+            }
+        }
+        {
+            unique_lock<mutex> guard(connection.lock);
+            connection.changed.wait(guard, [&] { return connection.queries_running == 0; });
+            connection.closed = true;
+            connection.changed.notify_all();
+        }
+        writer.join();
+        return !shutdown;
+    }
+
+public:
+    NetworkServer(Network& network, size_t num_threads) : network(network), query_pool(num_threads) {
+        network.allow_search_failures(); // a request whose search gets lost fails alone
+    }
+
+    NetworkServer(const NetworkServer&) = delete;
+    NetworkServer& operator=(const NetworkServer&) = delete;
+
+    // Answers requests on stdin and stdout until quit, shutdown or the end of stdin
+    void serve_stdio() {
+        serve_connection(STDIN_FILENO, STDOUT_FILENO);
+    }
+
+    // Answers the connections to a Unix domain socket at socket_path, each on its own thread, until one of
+    // them sends shutdown; the connections still open are then closed for reading and finish their requests.
+    // Returns false if the socket cannot be set up.
+    bool serve_socket(const string& socket_path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            cerr << "Error: Socket path " << socket_path << " is too long" << endl;
+            return false;
+        }
+        strcpy(address.sun_path, socket_path.c_str());
+        int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            cerr << "Error: Could not create a socket: " << strerror(errno) << endl;
+            return false;
+        }
+        unlink(socket_path.c_str());
+        if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+            cerr << "Error: Could not listen on " << socket_path << ": " << strerror(errno) << endl;
+            close(listen_fd);
+            return false;
+        }
+        signal(SIGPIPE, SIG_IGN); // a client closing early must not end the server
+        struct Handler {
+            thread worker;
+            shared_ptr<atomic<bool>> done = make_shared<atomic<bool>>(false);
+        };
+        vector<Handler> connections;
+        while (true) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            // join the threads of connections that have ended, so a long-running server does not keep them
+            for (size_t i = 0; i < connections.size();) {
+                if (*connections[i].done) {
+                    connections[i].worker.join();
+                    connections[i] = move(connections.back());
+                    connections.pop_back();
+                } else {
+                    i++;
+                }
+            }
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                break; // shut down
+            }
+            lock_guard<mutex> guard(connections_lock);
+            if (stopping) {
+                close(fd);
+                break;
+            }
+            connection_fds.insert(fd);
+            Handler handler;
+            handler.worker = thread([this, fd, listen_fd, done = handler.done]() {
+                bool running = serve_connection(fd, fd);
+                lock_guard<mutex> guard(connections_lock);
+                connection_fds.erase(fd);
+                close(fd);
+                if (!running && !stopping) {
+                    stopping = true;
+                    ::shutdown(listen_fd, SHUT_RDWR); // wakes accept
+                    for (int open_fd: connection_fds) {
+                        ::shutdown(open_fd, SHUT_RD);
+                    }
+                }
+                *done = true;
+            });
+            connections.push_back(move(handler));
+        }
+        for (Handler& connection: connections) {
+            connection.worker.join();
+        }
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        return true;
+    }
+};
+
+#endif // NETWORK_SERVER_H
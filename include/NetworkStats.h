@@ -0,0 +1,127 @@
+#ifndef NETWORK_STATS_H
+#define NETWORK_STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Counters of the greedy descent for one segment. Every segment is searched by one thread
+// at a time, so each segment's counters are only written by the thread searching it.
+struct SegmentSearchStats {
+    size_t num_searches = 0;
+    size_t total_depth = 0;        // descent steps summed over searches
+    size_t max_depth = 0;
+    size_t children_scanned = 0;   // child branches compared against the sample
+    size_t index_lookups = 0;      // branch index lookups made instead of scanning wide nodes
+    size_t set_operations = 0;     // mut_set intersections, splits, differences and unions
+    size_t summary_skips = 0;      // nodes whose children were not compared because no mutation of the sample is below them
+    size_t temporal_prunes = 0;    // children left out because everything below them is dated after the sample (--temporal-pruning)
+    size_t mutations_restored = 0; // matched mutations off the path the sample is grafted below, kept for its branch
+
+    void add_search(size_t depth) {
+        num_searches++;
+        total_depth += depth;
+        max_depth = max(max_depth, depth);
+    }
+
+    void merge(const SegmentSearchStats& other) {
+        num_searches += other.num_searches;
+        total_depth += other.total_depth;
+        max_depth = max(max_depth, other.max_depth);
+        children_scanned += other.children_scanned;
+        index_lookups += other.index_lookups;
+        set_operations += other.set_operations;
+        summary_skips += other.summary_skips;
+        temporal_prunes += other.temporal_prunes;
+        mutations_restored += other.mutations_restored;
+    }
+};
+
+// Profile of building a network, exported by --stats
+struct NetworkStats {
+    double load_seconds = 0;       // reading a snapshot
+    double parse_seconds = 0;
+    double search_seconds = 0;     // per-segment graft searches, wall time
+    double graft_seconds = 0;      // rewiring the network once the graft nodes are known
+    double write_seconds = 0;
+    double place_seconds = 0;      // --place queries
+    double compact_seconds = 0;    // --compact
+    double order_seconds = 0;      // --order
+    string sample_order = "file";  // order in which samples were grafted
+    size_t samples_grafted = 0;
+    size_t samples_skipped = 0;         // already in the network
+    size_t samples_placed = 0;          // --place queries
+    size_t hidden_nodes_created = 0;
+    size_t reassortment_nodes_created = 0;
+    size_t hidden_nodes_removed = 0;    // by compaction (--compact)
+    size_t parent_child_rejections = 0; // two graft nodes that were parent and child, so no reassortment was added
+    size_t ancestral_reassortments = 0; // reassortments between two graft nodes of which one descends from the other, counted with --ancestry-index
+    size_t graft_set_operations = 0;    // set operations made while rewiring
+    size_t batch_searches_repeated = 0; // --batch searches redone because an earlier sample of the batch changed their path
+    vector<SegmentSearchStats> segments;
+
+    static double seconds_since(chrono::steady_clock::time_point start) {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    static void write_json_string(ostream& out, const string& str) {
+        out << '"';
+        for (char c: str) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                out << ' ';
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    void write_json(ostream& out, const vector<string>& seg_names, size_t num_nodes) const {
+        size_t total_set_operations = graft_set_operations;
+        for (const SegmentSearchStats& seg_stats: segments) {
+            total_set_operations += seg_stats.set_operations;
+        }
+        out << "{\n";
+        out << "  \"phases\": {\"load_seconds\": " << load_seconds << ", \"parse_seconds\": " << parse_seconds << ", \"search_seconds\": " << search_seconds
+            << ", \"graft_seconds\": " << graft_seconds << ", \"write_seconds\": " << write_seconds << ", \"place_seconds\": " << place_seconds << ", \"compact_seconds\": " << compact_seconds << ", \"order_seconds\": " << order_seconds << "},\n";
+        out << "  \"sample_order\": ";
+        write_json_string(out, sample_order);
+        out << ",\n";
+        out << "  \"samples_grafted\": " << samples_grafted << ",\n";
+        out << "  \"samples_skipped\": " << samples_skipped << ",\n";
+        out << "  \"samples_placed\": " << samples_placed << ",\n";
+        out << "  \"nodes\": " << num_nodes << ",\n";
+        out << "  \"hidden_nodes_created\": " << hidden_nodes_created << ",\n";
+        out << "  \"reassortment_nodes_created\": " << reassortment_nodes_created << ",\n";
+        out << "  \"hidden_nodes_removed\": " << hidden_nodes_removed << ",\n";
+        out << "  \"parent_child_rejections\": " << parent_child_rejections << ",\n";
+        out << "  \"ancestral_reassortments\": " << ancestral_reassortments << ",\n";
+        out << "  \"set_operations\": " << total_set_operations << ",\n";
+        out << "  \"batch_searches_repeated\": " << batch_searches_repeated << ",\n";
+        out << "  \"segments\": [";
+        for (size_t seg = 0; seg < segments.size(); seg++) {
+            const SegmentSearchStats& seg_stats = segments[seg];
+            out << (seg == 0 ? "\n" : ",\n") << "    {\"name\": ";
+            write_json_string(out, seg < seg_names.size() ? seg_names[seg] : to_string(seg));
+            out << ", \"searches\": " << seg_stats.num_searches
+                << ", \"mean_depth\": " << (seg_stats.num_searches > 0 ? double(seg_stats.total_depth) / seg_stats.num_searches : 0.0)
+                << ", \"max_depth\": " << seg_stats.max_depth
+                << ", \"children_scanned\": " << seg_stats.children_scanned
+                << ", \"index_lookups\": " << seg_stats.index_lookups
+                << ", \"set_operations\": " << seg_stats.set_operations
+                << ", \"summary_skips\": " << seg_stats.summary_skips
+                << ", \"temporal_prunes\": " << seg_stats.temporal_prunes
+                << ", \"mutations_restored\": " << seg_stats.mutations_restored << "}";
+        }
+        out << (segments.empty() ? "]\n" : "\n  ]\n");
+        out << "}\n";
+    }
+};
+
+#endif // NETWORK_STATS_H
@@ -0,0 +1,361 @@
+#ifndef NETWORK_VERIFIER_H
+#define NETWORK_VERIFIER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Network.h"
+
+using namespace std;
+
+// Problems of each kind printed by NetworkVerifier::report; the rest are only counted
+const size_t VERIFY_REPORT_LIMIT = 10;
+
+// Checks a network for consistency (--verify):
+// - links: every child lists its parent, through Node::parent or parent4seg, and every parent lists its
+//   children; in_degree and out_degree count them; child_index is the position in children of parent;
+//   last_empty_child is up to date; branch mutations are sorted sets.
+// - reachability: per segment, every node with a parent is reached from root exactly once following
+//   parent_for_seg, so there are no cycles or detached subtrees.
+// - genotypes: per segment, what grafting guarantees of every sample: each of its mutations is on its path
+//   from root, which ends with its own branch, its branch holds only mutations it has, and an implicit
+//   genotype (--implicit-genotypes) still rebuilds from its path, see check_genotype.
+// The path of a sample may hold more than its genotype, even without reassortment in the data: the search
+// accepts the conflicting mutations of the branches it descends into, which end up on the path the sample
+// lacks. Those are only counted.
+// Segments are checked in parallel, each by one walk down its tree from root that keeps a count of every
+// mutation on the current path, so the path of every node is built from its parent's in time proportional
+// to the branch; node links are checked in parallel over blocks of nodes.
+class NetworkVerifier {
+private:
+    // Problems of one kind found by one task
+    struct Problems {
+        size_t count = 0;
+        vector<string> examples; // the first VERIFY_REPORT_LIMIT
+
+        // message() builds the text, only for the problems that are printed
+        template <typename Message>
+        void add(Message message) {
+            if (examples.size() < VERIFY_REPORT_LIMIT) {
+                examples.push_back(message());
+            }
+            count++;
+        }
+
+        void merge(const Problems& other) {
+            for (const string& message: other.examples) {
+                if (examples.size() < VERIFY_REPORT_LIMIT) {
+                    examples.push_back(message);
+                }
+            }
+            count += other.count;
+        }
+    };
+
+    struct SegmentResult {
+        Problems unreachable;
+        Problems genotypes;
+        size_t extra_muts = 0; // path mutations the sample lacks
+        vector<bool> differs;  // by node, samples whose path for the segment has mutations they lack
+    };
+
+    const Network& network;
+    ThreadPool& thread_pool;
+    Problems links;
+    Problems unreachable;
+    Problems genotypes;
+    size_t num_nodes = 0;
+    size_t num_samples = 0;
+    size_t unattached_samples = 0; // left without a parent, see NetworkStats::parent_child_rejections
+    size_t samples_differing = 0;  // samples with a segment whose path has mutations they lack
+    size_t extra_muts = 0;
+    double seconds = 0;
+
+    static bool is_sorted_set(const mut_set& muts) {
+        return adjacent_find(muts.begin(), muts.end(), [](mut_id a, mut_id b) { return a >= b; }) == muts.end();
+    }
+
+    bool is_sample(node_id id) const {
+        const Node& n = network.node(id);
+        return id != network.get_root() && !n.hidden_node && !n.reassortment_node;
+    }
+
+    bool lists_child(node_id parent_id, node_id child_id) const {
+        const vector<node_id>& children = network.node(parent_id).children;
+        return find(children.begin(), children.end(), child_id) != children.end();
+    }
+
+    void check_links(node_id id, Problems& problems) const {
+        const Node& n = network.node(id);
+        const string& name = n.name;
+        size_t num_segs = network.get_seg_names().size();
+        vector<node_id> parents; // distinct parents, each of which must list id
+        if (n.parent != NO_NODE) {
+            parents.push_back(n.parent);
+        }
+        for (node_id seg_parent: n.parent4seg) {
+            if (seg_parent != NO_NODE && find(parents.begin(), parents.end(), seg_parent) == parents.end()) {
+                parents.push_back(seg_parent);
+            }
+        }
+        for (node_id parent_id: parents) {
+            if (!network.is_live(parent_id)) {
+                problems.add([&] { return name + " has a removed node as parent"; });
+            } else if (!lists_child(parent_id, id)) {
+                problems.add([&] { return name + " is not a child of its parent " + network.node(parent_id).name; });
+            }
+        }
+        if (n.in_degree != static_cast<int>(parents.size())) {
+            problems.add([&] { return name + " has in_degree " + to_string(n.in_degree) + " but " + to_string(parents.size()) + " parents"; });
+        }
+        if (n.out_degree != static_cast<int>(n.children.size())) {
+            problems.add([&] { return name + " has out_degree " + to_string(n.out_degree) + " but " + to_string(n.children.size()) + " children"; });
+        }
+        if (n.parent != NO_NODE && network.is_live(n.parent)) {
+            const vector<node_id>& siblings = network.node(n.parent).children;
+            if (n.child_index >= siblings.size() || siblings[n.child_index] != id) {
+                problems.add([&] { return name + " has child_index " + to_string(n.child_index) + " but is not at that position in the children of " + network.node(n.parent).name; });
+            }
+        }
+        if (n.branch_mutations.size() != num_segs || (!n.parent4seg.empty() && n.parent4seg.size() != num_segs)) {
+            problems.add([&] { return name + " does not have one branch and parent per segment"; });
+            return;
+        }
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            const mut_set& branch = n.branch_mutations[seg];
+            if (!is_sorted_set(branch)) {
+                problems.add([&] { return name + " has unsorted branch mutations for " + network.get_seg_names()[seg]; });
+            } else if (!branch.empty() && branch.back() >= network.get_mutation_dict().size()) {
+                problems.add([&] { return name + " has a branch mutation for " + network.get_seg_names()[seg] + " that is not in the mutation dictionary"; });
+            }
+        }
+        vector<node_id> children = n.children;
+        sort(children.begin(), children.end());
+        if (adjacent_find(children.begin(), children.end()) != children.end()) {
+            problems.add([&] { return name + " lists a child twice"; });
+        }
+        for (size_t i = 0; i < n.children.size(); i++) {
+            node_id child_id = n.children[i];
+            if (!network.is_live(child_id)) {
+                problems.add([&] { return name + " has a removed node as child"; });
+                return;
+            }
+            const Node& child = network.node(child_id);
+            if (child.parent != id && find(child.parent4seg.begin(), child.parent4seg.end(), id) == child.parent4seg.end()) {
+                problems.add([&] { return name + " lists " + child.name + " as child but is not its parent"; });
+            }
+        }
+        if (!n.children.empty()) {
+            for (size_t seg = 0; seg < num_segs; seg++) {
+                int last_empty = -1;
+                for (size_t i = n.children.size(); i-- > 0;) {
+                    if (network.node(n.children[i]).branch_mutations[seg].empty()) {
+                        last_empty = static_cast<int>(i);
+                        break;
+                    }
+                }
+                if (seg >= n.last_empty_child.size() || n.last_empty_child[seg] != last_empty) {
+                    problems.add([&] { return name + " has a stale last_empty_child for " + network.get_seg_names()[seg]; });
+                }
+            }
+        }
+    }
+
+    // Walks the tree of seg from root. counts holds, for every mutation, the branches on the current path
+    // that carry it, and on_path the mutations counted at least once.
+    void check_segment(size_t seg, SegmentResult& result) const {
+        const string& seg_name = network.get_seg_names()[seg];
+        node_id capacity = network.node_capacity();
+        vector<uint32_t> counts(network.get_mutation_dict().size(), 0);
+        size_t on_path = 0;
+        vector<bool> reached(capacity, false);
+        result.differs.assign(capacity, false);
+        vector<pair<node_id, size_t>> stack; // node and the position in its children to look at next
+        auto enter = [&](node_id id) {
+            reached[id] = true;
+            for (mut_id mut: network.node(id).branch_mutations[seg]) {
+                if (mut < counts.size()) { // others are reported by check_links
+                    on_path += counts[mut]++ == 0;
+                }
+            }
+            stack.emplace_back(id, 0);
+            if (is_sample(id)) {
+                check_genotype(id, seg, counts, on_path, result);
+            }
+        };
+        enter(network.get_root());
+        while (!stack.empty()) {
+            auto& [id, next_child] = stack.back();
+            const Node& n = network.node(id);
+            if (next_child < n.children.size()) {
+                node_id child_id = n.children[next_child++];
+                if (network.is_live(child_id) && network.parent_for_seg(network.node(child_id), seg) == id) {
+                    if (reached[child_id]) {
+                        result.unreachable.add([&] { return network.node(child_id).name + " is reached twice from root for " + seg_name; });
+                    } else {
+                        enter(child_id);
+                    }
+                }
+                continue;
+            }
+            for (mut_id mut: n.branch_mutations[seg]) {
+                if (mut < counts.size()) {
+                    on_path -= --counts[mut] == 0;
+                }
+            }
+            stack.pop_back();
+        }
+        for (node_id id = 0; id < capacity; id++) {
+            if (network.is_live(id) && !reached[id] && network.parent_for_seg(network.node(id), seg) != NO_NODE) {
+                result.unreachable.add([&] { return network.node(id).name + " is not reached from root for " + seg_name; });
+            }
+        }
+    }
+
+    // Checks what grafting guarantees about the genotype of sample id for seg: every mutation of it is on the
+    // path walked here, its own branch holds only mutations it has and, if its genotype is implicit, the
+    // difference recorded when it was released still holds against its path, i.e. the path mutations it lacks
+    // are on the path and those it has off the path are not, and the genotype rebuilt from the path walked
+    // here is the one Network::sample_genotype rebuilds. A mutation off the path means a graft dropped it,
+    // see Network::restore_off_path_mutations. Path mutations the sample lacks are only counted.
+    void check_genotype(node_id id, size_t seg, const vector<uint32_t>& counts, size_t on_path, SegmentResult& result) const {
+        const Node& n = network.node(id);
+        const string& seg_name = network.get_seg_names()[seg];
+        auto on_current_path = [&](mut_id mut) { return mut < counts.size() && counts[mut] > 0; };
+        static const mut_set no_muts;
+        mut_set rebuilt;
+        const mut_set * genotype = &no_muts;
+        size_t missing = 0, extra = 0;
+        if (n.implicit_genotype) { // the genotype is the path with the recorded difference applied
+            mut_set lacking, off_path;
+            if (!n.genotype_delta.empty()) {
+                const mut_id * parts = n.genotype_delta.data();
+                lacking.assign(parts + parts[2 * seg], parts + parts[2 * seg + 1]);
+                off_path.assign(parts + parts[2 * seg + 1], parts + parts[2 * seg + 2]);
+            }
+            if (!all_of(lacking.begin(), lacking.end(), on_current_path) || any_of(off_path.begin(), off_path.end(), on_current_path)) {
+                result.genotypes.add([&] { return n.name + " for " + seg_name + ": the difference recorded between its genotype and its path no longer matches the path"; });
+            }
+            rebuilt = network.sample_genotype(id, seg);
+            size_t rebuilt_on_path = 0;
+            bool matches = true;
+            for (mut_id mut: rebuilt) {
+                bool is_lacking = binary_search(lacking.begin(), lacking.end(), mut);
+                bool is_off_path = binary_search(off_path.begin(), off_path.end(), mut);
+                matches = matches && !is_lacking && (on_current_path(mut) || is_off_path);
+                rebuilt_on_path += on_current_path(mut);
+            }
+            if (!matches || rebuilt.size() - rebuilt_on_path != off_path.size() || rebuilt_on_path + lacking.size() != on_path) {
+                result.genotypes.add([&] { return n.name + " for " + seg_name + ": the genotype rebuilt from its path differs from the walk from root"; });
+            }
+            genotype = &rebuilt;
+            missing = off_path.size();
+            extra = lacking.size();
+        } else {
+            if (!n.sample_mutations.empty()) {
+                genotype = &n.sample_mutations[seg];
+            }
+            for (mut_id mut: *genotype) {
+                missing += !on_current_path(mut);
+            }
+            extra = on_path - (genotype->size() - missing);
+        }
+        if (missing > 0) {
+            result.genotypes.add([&] { return n.name + " for " + seg_name + ": " + to_string(missing) + " of its mutations are not on its path"; });
+        }
+        if (!includes(genotype->begin(), genotype->end(), n.branch_mutations[seg].begin(), n.branch_mutations[seg].end())) {
+            result.genotypes.add([&] { return n.name + " for " + seg_name + ": its branch has mutations the sample does not"; });
+        }
+        if (extra > 0) {
+            result.differs[id] = true;
+            result.extra_muts += extra;
+        }
+    }
+
+public:
+    NetworkVerifier(const Network& network, ThreadPool& thread_pool) : network(network), thread_pool(thread_pool) {}
+
+    // Runs every check, returns whether the network passed them all
+    bool verify() {
+        auto start = chrono::steady_clock::now();
+        node_id capacity = network.node_capacity();
+        size_t num_segs = network.get_seg_names().size();
+        if (network.get_root() == NO_NODE) {
+            links.add([&] { return string("the network has no root"); });
+            return false;
+        }
+
+        const size_t block_size = 4096;
+        size_t num_blocks = (capacity + block_size - 1) / block_size;
+        vector<Problems> block_links(num_blocks);
+        vector<size_t> block_samples(num_blocks, 0), block_unattached(num_blocks, 0), block_nodes(num_blocks, 0);
+        vector<SegmentResult> segments(num_segs);
+        thread_pool.parallel_for(num_blocks + num_segs, [&](size_t task) {
+            if (task < num_segs) { // segments first, they take longest
+                check_segment(task, segments[task]);
+                return;
+            }
+            size_t block = task - num_segs;
+            for (node_id id = block * block_size; id < min<size_t>(capacity, (block + 1) * block_size); id++) {
+                if (!network.is_live(id)) {
+                    continue;
+                }
+                block_nodes[block]++;
+                check_links(id, block_links[block]);
+                if (is_sample(id)) {
+                    block_samples[block]++;
+                    block_unattached[block] += network.node(id).parent == NO_NODE;
+                }
+            }
+        });
+
+        for (size_t block = 0; block < num_blocks; block++) {
+            links.merge(block_links[block]);
+            num_nodes += block_nodes[block];
+            num_samples += block_samples[block];
+            unattached_samples += block_unattached[block];
+        }
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            unreachable.merge(segments[seg].unreachable);
+            genotypes.merge(segments[seg].genotypes);
+            extra_muts += segments[seg].extra_muts;
+        }
+        for (node_id id = 0; id < capacity; id++) {
+            samples_differing += any_of(segments.begin(), segments.end(), [id](const SegmentResult& result) { return result.differs[id]; });
+        }
+        seconds = NetworkStats::seconds_since(start);
+        return passed();
+    }
+
+    bool passed() const {
+        return links.count == 0 && unreachable.count == 0 && genotypes.count == 0;
+    }
+
+    // Prints a summary to out and up to VERIFY_REPORT_LIMIT problems of each kind to cerr
+    void report(ostream& out) const {
+        auto print = [](const Problems& problems) {
+            for (const string& message: problems.examples) {
+                cerr << "Error: " << message << endl;
+            }
+            if (problems.count > problems.examples.size()) {
+                cerr << "Error: ... and " << problems.count - problems.examples.size() << " more" << endl;
+            }
+        };
+        print(links);
+        print(unreachable);
+        print(genotypes);
+        out << "Verified " << num_nodes << " nodes, " << num_samples << " samples in " << seconds << " s" << endl;
+        out << "  links: " << links.count << " problems" << endl;
+        out << "  reachability: " << unreachable.count << " problems" << endl;
+        out << "  genotypes: " << genotypes.count << " problems" << endl;
+        out << "  paths: " << (num_samples - unattached_samples - samples_differing) << " samples have their genotype as path, " << samples_differing
+            << " have path mutations they lack (" << extra_muts << " in all), " << unattached_samples << " unattached" << endl;
+        out << (passed() ? "Network is consistent" : "Network is not consistent") << endl;
+    }
+};
+
+#endif // NETWORK_VERIFIER_H
@@ -0,0 +1,75 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Nodes are referred to by 32-bit handles into the arena that stores them
+typedef uint32_t node_id;
+
+const node_id NO_NODE = numeric_limits<node_id>::max();
+
+// Slab allocator with stable 32-bit handles. Objects live in fixed-size slabs that are
+// never moved, so references stay valid while other objects are created; destroyed
+// slots go to a free list and are reused by later creations.
+template <typename T>
+class SlabArena {
+private:
+    static const uint32_t SLAB_BITS = 12;
+    static const uint32_t SLAB_SIZE = 1u << SLAB_BITS;
+
+    vector<unique_ptr<T[]>> slabs;
+    vector<bool> live;
+    vector<node_id> free_slots;
+    size_t num_live = 0;
+
+public:
+    SlabArena() = default;
+    SlabArena(const SlabArena&) = delete;
+    SlabArena& operator=(const SlabArena&) = delete;
+    SlabArena(SlabArena&&) = default;
+    SlabArena& operator=(SlabArena&&) = default;
+
+    template <typename... Args>
+    node_id create(Args&&... args) {
+        node_id slot;
+        if (!free_slots.empty()) {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            slot = static_cast<node_id>(live.size());
+            if (slot == slabs.size() * SLAB_SIZE) {
+                slabs.push_back(make_unique<T[]>(SLAB_SIZE));
+            }
+            live.push_back(false);
+        }
+        (*this)[slot] = T(forward<Args>(args)...);
+        live[slot] = true;
+        num_live++;
+        return slot;
+    }
+
+    void destroy(node_id slot) {
+        (*this)[slot] = T();
+        live[slot] = false;
+        free_slots.push_back(slot);
+        num_live--;
+    }
+
+    T& operator[](node_id slot) { return slabs[slot >> SLAB_BITS][slot & (SLAB_SIZE - 1)]; }
+    const T& operator[](node_id slot) const { return slabs[slot >> SLAB_BITS][slot & (SLAB_SIZE - 1)]; }
+
+    bool is_live(node_id slot) const { return slot < live.size() && live[slot]; }
+    // Destroyed slots in the order they will be reused from the back
+    const vector<node_id>& free_list() const { return free_slots; }
+    size_t size() const { return num_live; }
+    // Number of slots ever handed out; live objects have handles below this
+    node_id capacity() const { return static_cast<node_id>(live.size()); }
+};
+
+#endif // NODE_ARENA_H
@@ -0,0 +1,183 @@
+#ifndef SAMPLE_ORDER_H
+#define SAMPLE_ORDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Date.h"
+#include "MutationSet.h"
+#include "SampleTable.h"
+
+using namespace std;
+
+// Orders in which the samples of a mutations file can be grafted (--order). The first sample becomes the
+// child of root and every later one is placed on the network grafted so far, so the order decides how
+// many hidden and reassortment nodes are created and how deep later searches go.
+enum class SampleOrder {
+    file,      // as listed
+    date,      // oldest first, by the Date column read as by parse_day; samples without a valid date last
+    mutations, // fewest mutations first, i.e. closest to root
+    nearest    // from the sample with the fewest mutations, each next one the nearest of those left
+};
+
+// Samples compared with the current one by the nearest neighbour order, found through shared mutations
+const size_t NEAREST_NEIGHBOUR_CANDIDATES = 64;
+
+inline bool parse_sample_order(const string& name, SampleOrder& order) {
+    if (name == "file") {
+        order = SampleOrder::file;
+    } else if (name == "date") {
+        order = SampleOrder::date;
+    } else if (name == "mutations") {
+        order = SampleOrder::mutations;
+    } else if (name == "nearest") {
+        order = SampleOrder::nearest;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline const char * sample_order_name(SampleOrder order) {
+    switch (order) {
+        case SampleOrder::date: return "date";
+        case SampleOrder::mutations: return "mutations";
+        case SampleOrder::nearest: return "nearest";
+        default: return "file";
+    }
+}
+
+// Greedy nearest neighbour chain: starting from the sample with the fewest mutations, the next sample is the
+// one left whose mutations differ from the current sample's in the fewest (segment, mutation) pairs, so that
+// similar samples are grafted one after another. Candidates are the samples that share the current sample's
+// rarest mutations, at most NEAREST_NEIGHBOUR_CANDIDATES of them, and the sample left with the fewest
+// mutations; ties go to the sample listed first. Posting lists drop grafted samples as they are scanned.
+inline vector<size_t> nearest_neighbour_order(const SampleTable& samples) {
+    size_t num_samples = samples.size();
+    size_t num_segs = samples.seg_names().size();
+    vector<vector<uint64_t>> keys(num_samples); // sorted (mutation, segment) pairs of each sample
+    vector<mut_set> mutations;
+    for (size_t i = 0; i < num_samples; i++) {
+        samples.get_mutations(i, mutations);
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            for (mut_id mut: mutations[seg]) {
+                keys[i].push_back(uint64_t(mut) * num_segs + seg);
+            }
+        }
+        sort(keys[i].begin(), keys[i].end());
+    }
+    // Mutation IDs are shared by all segments, so most (mutation, segment) pairs never occur: the keys are
+    // renumbered densely, in the same order, to index the postings by the pairs that do
+    vector<uint64_t> distinct_keys;
+    for (const vector<uint64_t>& sample_keys: keys) {
+        distinct_keys.insert(distinct_keys.end(), sample_keys.begin(), sample_keys.end());
+    }
+    sort(distinct_keys.begin(), distinct_keys.end());
+    distinct_keys.erase(unique(distinct_keys.begin(), distinct_keys.end()), distinct_keys.end());
+    for (vector<uint64_t>& sample_keys: keys) {
+        for (uint64_t& key: sample_keys) {
+            key = lower_bound(distinct_keys.begin(), distinct_keys.end(), key) - distinct_keys.begin();
+        }
+    }
+    vector<vector<uint32_t>> postings(distinct_keys.size()); // samples not yet ordered, by key
+    for (size_t i = num_samples; i-- > 0;) {
+        for (uint64_t key: keys[i]) {
+            postings[key].push_back(i);
+        }
+    }
+    vector<size_t> by_size(num_samples);
+    for (size_t i = 0; i < num_samples; i++) {
+        by_size[i] = i;
+    }
+    stable_sort(by_size.begin(), by_size.end(), [&](size_t a, size_t b) { return keys[a].size() < keys[b].size(); });
+
+    auto distance = [&](size_t a, size_t b) {
+        size_t common = 0;
+        for (auto it_a = keys[a].begin(), it_b = keys[b].begin(); it_a != keys[a].end() && it_b != keys[b].end();) {
+            if (*it_a < *it_b) {
+                ++it_a;
+            } else if (*it_b < *it_a) {
+                ++it_b;
+            } else {
+                common++;
+                ++it_a;
+                ++it_b;
+            }
+        }
+        return keys[a].size() + keys[b].size() - 2 * common;
+    };
+
+    vector<size_t> order;
+    order.reserve(num_samples);
+    vector<bool> ordered(num_samples, false);
+    vector<size_t> compared_at(num_samples, SIZE_MAX); // step at which a sample was last compared
+    vector<uint64_t> rarest_first;
+    size_t smallest_left = 0; // position in by_size
+    for (size_t current = num_samples > 0 ? by_size[0] : 0; order.size() < num_samples;) {
+        ordered[current] = true;
+        order.push_back(current);
+        size_t step = order.size();
+        while (smallest_left < num_samples && ordered[by_size[smallest_left]]) {
+            smallest_left++;
+        }
+        if (smallest_left == num_samples) {
+            break;
+        }
+        size_t best = by_size[smallest_left];
+        size_t best_distance = distance(current, best);
+        rarest_first = keys[current];
+        sort(rarest_first.begin(), rarest_first.end(), [&](uint64_t a, uint64_t b) { return postings[a].size() < postings[b].size(); });
+        size_t num_candidates = 0;
+        for (uint64_t key: rarest_first) {
+            vector<uint32_t>& posting = postings[key];
+            for (size_t i = 0; i < posting.size() && num_candidates < NEAREST_NEIGHBOUR_CANDIDATES && best_distance > 0;) {
+                size_t candidate = posting[i];
+                if (ordered[candidate]) {
+                    posting[i] = posting.back();
+                    posting.pop_back();
+                    continue;
+                }
+                i++;
+                if (compared_at[candidate] == step) {
+                    continue;
+                }
+                compared_at[candidate] = step;
+                num_candidates++;
+                size_t candidate_distance = distance(current, candidate);
+                if (candidate_distance < best_distance || (candidate_distance == best_distance && candidate < best)) {
+                    best = candidate;
+                    best_distance = candidate_distance;
+                }
+            }
+        }
+        current = best;
+    }
+    return order;
+}
+
+// The order in which to graft samples: order_samples(samples, order)[i] is the sample to graft i-th
+inline vector<size_t> order_samples(const SampleTable& samples, SampleOrder order) {
+    if (order == SampleOrder::nearest) {
+        return nearest_neighbour_order(samples);
+    }
+    vector<size_t> sample_order(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+        sample_order[i] = i;
+    }
+    if (order == SampleOrder::date) {
+        vector<day_t> days(samples.size()); // as --temporal-pruning reads them, NO_DAY sorts last
+        for (size_t i = 0; i < samples.size(); i++) {
+            days[i] = parse_day(samples.date(i));
+        }
+        stable_sort(sample_order.begin(), sample_order.end(), [&](size_t a, size_t b) {
+            return days[a] != days[b] ? days[a] < days[b] : samples.date(a) < samples.date(b);
+        });
+    } else if (order == SampleOrder::mutations) {
+        stable_sort(sample_order.begin(), sample_order.end(), [&](size_t a, size_t b) { return samples.num_mutations(a) < samples.num_mutations(b); });
+    }
+    return sample_order;
+}
+
+#endif // SAMPLE_ORDER_H
@@ -0,0 +1,167 @@
+#ifndef SAMPLE_STREAM_H
+#define SAMPLE_STREAM_H
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MutationDictionary.h"
+#include "SampleTable.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Reads a mutations CSV a block of whole lines at a time, so that the samples of a block can be grafted
+// while later blocks are still being parsed. Regular files are memory-mapped and every block is a view
+// into the mapping, which must outlive the blocks. Pipes ("-" is standard input) are read as a stream:
+// only the current block and the partial line after it are held in memory, and each block is copied out.
+class SampleStream {
+private:
+    int fd = -1;
+    MappedFile mapped;
+    bool use_mapped = false;
+    string_view text; // unread part of a mapped file
+    string pending; // read from a pipe; pending[pending_start ...] is not yet handed out
+    size_t pending_start = 0;
+    size_t line_number = 0; // lines handed out so far, header included
+    bool at_end = false;
+
+    static const size_t BLOCK_SIZE = 4 << 20;
+
+    size_t pending_size() const { return pending.size() - pending_start; }
+    string_view unread() const { return string_view(pending).substr(pending_start); }
+
+    // Reads until at least size bytes are pending or the input ends; returns false on a read error
+    bool fill(size_t size) {
+        if (pending_start > 0 && pending_start >= pending.size() / 2) { // drop what was handed out, at most as much as is kept
+            pending.erase(0, pending_start);
+            pending_start = 0;
+        }
+        char read_buffer[1 << 16];
+        while (!at_end && pending_size() < size) {
+            ssize_t num_read = ::read(fd, read_buffer, sizeof(read_buffer));
+            if (num_read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (num_read < 0) {
+                return false;
+            }
+            if (num_read == 0) {
+                at_end = true;
+            }
+            pending.append(read_buffer, num_read);
+        }
+        return true;
+    }
+
+    // Length of the next block of text, whole lines unless it is the end of the input
+    static size_t block_length(string_view text, bool complete) {
+        if (text.size() <= BLOCK_SIZE && complete) {
+            return text.size();
+        }
+        size_t newline = text.rfind('\n', (text.size() < BLOCK_SIZE ? text.size() : BLOCK_SIZE) - 1); // not min, which would need BLOCK_SIZE defined out of the class
+        if (newline == string_view::npos) { // a line longer than a block
+            newline = text.find('\n', BLOCK_SIZE);
+        }
+        return newline == string_view::npos ? (complete ? text.size() : 0) : newline + 1;
+    }
+
+public:
+    SampleStream() = default;
+    SampleStream(const SampleStream&) = delete;
+    SampleStream& operator=(const SampleStream&) = delete;
+
+    ~SampleStream() {
+        if (fd > STDERR_FILENO) {
+            ::close(fd);
+        }
+    }
+
+    bool open(const string& file_name) {
+        struct stat file_stat;
+        if (file_name != "-" && ::stat(file_name.c_str(), &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+            if (!mapped.open(file_name)) {
+                cerr << "Error: Could not open file " << file_name << endl;
+                return false;
+            }
+            use_mapped = true;
+            text = mapped.view();
+            return true;
+        }
+        fd = file_name == "-" ? STDIN_FILENO : ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cerr << "Error: Could not open file " << file_name << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the header line and returns the segment names it lists
+    bool read_header(vector<string>& seg_names) {
+        if (use_mapped) {
+            size_t header_end = min(text.find('\n'), text.size());
+            seg_names = SampleTable::parse_header(text.substr(0, header_end));
+            text.remove_prefix(min(header_end + 1, text.size()));
+            line_number = 1;
+            return true;
+        }
+        size_t header_end;
+        while ((header_end = unread().find('\n')) == string_view::npos && !at_end) {
+            if (!fill(pending_size() + 1)) {
+                cerr << "Error: Failed reading the header of the mutations file" << endl;
+                return false;
+            }
+        }
+        header_end = min(header_end, pending_size());
+        seg_names = SampleTable::parse_header(unread().substr(0, header_end));
+        pending_start += min(header_end + 1, pending_size());
+        line_number = 1;
+        return true;
+    }
+
+    // Parses the next block of lines, or returns nullptr once the input is exhausted
+    unique_ptr<SampleTable> next_block(const vector<string>& seg_names, ThreadPool& thread_pool, MutationDictionary& mutation_dict) {
+        auto samples = make_unique<SampleTable>();
+        size_t first_line = line_number;
+        if (use_mapped) {
+            if (text.empty()) {
+                return nullptr;
+            }
+            string_view block = text.substr(0, block_length(text, true));
+            text.remove_prefix(block.size());
+            line_number += count(block.begin(), block.end(), '\n');
+            samples->load_view(block, seg_names, first_line, thread_pool, mutation_dict);
+            return samples;
+        }
+        if (!fill(BLOCK_SIZE)) {
+            cerr << "Error: Failed reading the mutations file after line " << line_number << endl;
+            return nullptr;
+        }
+        size_t length;
+        while ((length = block_length(unread(), at_end)) == 0 && !at_end) { // a line longer than a block
+            if (!fill(pending_size() * 2)) {
+                cerr << "Error: Failed reading the mutations file after line " << line_number << endl;
+                return nullptr;
+            }
+        }
+        if (length == 0) {
+            return nullptr;
+        }
+        string block(unread().substr(0, length));
+        pending_start += length;
+        line_number += count(block.begin(), block.end(), '\n');
+        samples->load_lines(move(block), seg_names, first_line, thread_pool, mutation_dict);
+        return samples;
+    }
+};
+
+#endif // SAMPLE_STREAM_H
@@ -0,0 +1,281 @@
+#ifndef SAMPLE_TABLE_H
+#define SAMPLE_TABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
+#include "MutationDictionary.h"
+#include "MutationSet.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Helper function to trim whitespace from a string view without copying
+inline string_view trim_view(string_view str) {
+    size_t first = str.find_first_not_of(" \t\n\r");
+    if (first == string_view::npos) {
+        return string_view();
+    }
+    size_t last = str.find_last_not_of(" \t\n\r");
+    return str.substr(first, last - first + 1);
+}
+
+// Samples of a mutations CSV ("Date,ID,<segment>,..." header, one row per sample,
+// mutations of a segment separated by ':') in file order. The file is split into
+// line-aligned chunks that are tokenized in parallel; dates and IDs are views into
+// the mapped file and mutations are stored as one flat array of interned IDs.
+// A table can also hold just a block of lines of a file that is read as a stream (see SampleStream.h).
+class SampleTable {
+private:
+    // Rows are parsed per chunk with chunk-local mutation IDs, which are then mapped to
+    // dictionary IDs. Chunk dictionaries are merged in file order, so IDs are assigned in
+    // order of first appearance exactly as if the file had been read line by line.
+    struct Chunk {
+        string_view text;
+        size_t num_lines = 0;
+        vector<string_view> dates;
+        vector<string_view> ids;
+        vector<mut_id> muts;
+        vector<size_t> seg_offsets{0};
+        vector<string_view> local_names;
+        unordered_map<string_view, mut_id> local_ids;
+        vector<pair<size_t, string>> errors; // (line within chunk, message)
+    };
+
+    MappedFile file;
+    string lines; // text of a block loaded by load_lines
+    vector<string> segment_names;
+    vector<string_view> sample_dates;
+    vector<string_view> sample_ids;
+    vector<mut_id> sample_muts;
+    vector<size_t> seg_offsets; // mutations of sample i, segment seg are sample_muts[seg_offsets[i * num_segs + seg] ...]
+
+    static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    void parse_chunk(Chunk& chunk) const {
+        size_t num_columns = segment_names.size() + 2;
+        vector<string_view> tokens;
+        size_t pos = 0;
+        while (pos < chunk.text.size()) {
+            size_t line_end = chunk.text.find('\n', pos);
+            if (line_end == string_view::npos) {
+                line_end = chunk.text.size();
+            }
+            string_view line = chunk.text.substr(pos, line_end - pos);
+            pos = line_end + 1;
+            chunk.num_lines++;
+            if (trim_view(line).empty()) {
+                continue;
+            }
+            tokens.clear();
+            size_t token_start = 0;
+            while (true) {
+                size_t comma = line.find(',', token_start);
+                tokens.push_back(trim_view(line.substr(token_start, comma == string_view::npos ? string_view::npos : comma - token_start)));
+                if (comma == string_view::npos) {
+                    break;
+                }
+                token_start = comma + 1;
+            }
+            if (tokens.size() < 2 || tokens.size() > num_columns) { // Skip invalid lines
+                chunk.errors.emplace_back(chunk.num_lines, "has " + to_string(tokens.size()) + " columns, expected " + to_string(num_columns));
+                continue;
+            }
+            tokens.resize(num_columns); // missing trailing columns are empty segments
+            chunk.dates.push_back(tokens[0]);
+            chunk.ids.push_back(tokens[1]);
+            for (size_t i = 2; i < num_columns; i++) {
+                string_view cell = tokens[i];
+                size_t mut_start = 0;
+                while (mut_start <= cell.size() && !cell.empty()) {
+                    size_t colon = cell.find(':', mut_start);
+                    string_view mutation = trim_view(cell.substr(mut_start, colon == string_view::npos ? string_view::npos : colon - mut_start));
+                    if (!mutation.empty()) {
+                        auto inserted = chunk.local_ids.emplace(mutation, static_cast<mut_id>(chunk.local_names.size()));
+                        if (inserted.second) {
+                            chunk.local_names.push_back(mutation);
+                        }
+                        chunk.muts.push_back(inserted.first->second);
+                    }
+                    if (colon == string_view::npos) {
+                        break;
+                    }
+                    mut_start = colon + 1;
+                }
+                chunk.seg_offsets.push_back(chunk.muts.size());
+            }
+        }
+    }
+
+    // Replaces chunk-local IDs with dictionary IDs and sorts the mutations of every (sample, segment)
+    static void remap_chunk(Chunk& chunk, const vector<mut_id>& dict_ids) {
+        size_t write_pos = 0;
+        for (size_t cell = 0; cell + 1 < chunk.seg_offsets.size(); cell++) {
+            auto first = chunk.muts.begin() + chunk.seg_offsets[cell];
+            auto last = chunk.muts.begin() + chunk.seg_offsets[cell + 1];
+            for (auto it = first; it != last; ++it) {
+                *it = dict_ids[*it];
+            }
+            sort(first, last);
+            last = unique(first, last);
+            chunk.seg_offsets[cell] = write_pos;
+            write_pos = move(first, last, chunk.muts.begin() + write_pos) - chunk.muts.begin();
+        }
+        chunk.seg_offsets.back() = write_pos;
+        chunk.muts.resize(write_pos);
+    }
+
+    // Parses body, the lines that follow line first_line of the file
+    void parse_body(string_view body, size_t first_line, ThreadPool& thread_pool, MutationDictionary& mutation_dict) {
+        // Split the body into line-aligned chunks, a few per thread so that uneven chunks balance out
+        size_t num_chunks = max<size_t>(1, min(thread_pool.size() * 4, body.size() / MIN_CHUNK_SIZE));
+        vector<Chunk> chunks;
+        size_t chunk_start = 0;
+        for (size_t i = 0; i < num_chunks && chunk_start < body.size(); i++) {
+            size_t chunk_end = (i + 1 == num_chunks) ? body.size() : body.size() * (i + 1) / num_chunks;
+            if (chunk_end < chunk_start) {
+                chunk_end = chunk_start;
+            }
+            size_t newline = body.find('\n', chunk_end == 0 ? 0 : chunk_end - 1);
+            chunk_end = newline == string_view::npos ? body.size() : newline + 1;
+            chunks.emplace_back();
+            chunks.back().text = body.substr(chunk_start, chunk_end - chunk_start);
+            chunk_start = chunk_end;
+        }
+
+        thread_pool.parallel_for(chunks.size(), [&](size_t i) { parse_chunk(chunks[i]); });
+
+        vector<vector<mut_id>> dict_ids(chunks.size());
+        size_t line_number = first_line;
+        size_t num_samples = 0;
+        size_t num_muts = 0;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            for (const auto& [chunk_line, message] : chunks[i].errors) {
+                cerr << "Error: Line " << line_number + chunk_line << " " << message << endl;
+            }
+            line_number += chunks[i].num_lines;
+            dict_ids[i].reserve(chunks[i].local_names.size());
+            for (string_view mutation: chunks[i].local_names) {
+                dict_ids[i].push_back(mutation_dict.intern(mutation));
+            }
+            num_samples += chunks[i].ids.size();
+            num_muts += chunks[i].muts.size();
+        }
+
+        thread_pool.parallel_for(chunks.size(), [&](size_t i) { remap_chunk(chunks[i], dict_ids[i]); });
+
+        sample_dates.clear();
+        sample_ids.clear();
+        sample_muts.clear();
+        seg_offsets.assign(1, 0);
+        sample_dates.reserve(num_samples);
+        sample_ids.reserve(num_samples);
+        sample_muts.reserve(num_muts);
+        seg_offsets.reserve(num_samples * segment_names.size() + 1);
+        for (Chunk& chunk: chunks) {
+            sample_dates.insert(sample_dates.end(), chunk.dates.begin(), chunk.dates.end());
+            sample_ids.insert(sample_ids.end(), chunk.ids.begin(), chunk.ids.end());
+            size_t base = sample_muts.size();
+            sample_muts.insert(sample_muts.end(), chunk.muts.begin(), chunk.muts.end());
+            for (size_t cell = 1; cell < chunk.seg_offsets.size(); cell++) {
+                seg_offsets.push_back(base + chunk.seg_offsets[cell]);
+            }
+        }
+    }
+
+public:
+    // Segment names listed in the header line of a mutations CSV, i.e. the columns after Date and ID
+    static vector<string> parse_header(string_view header) {
+        vector<string> names;
+        size_t column = 0;
+        for (size_t token_start = 0; token_start <= header.size(); column++) {
+            size_t comma = min(header.find(',', token_start), header.size());
+            if (column >= 2) {
+                names.emplace_back(trim_view(header.substr(token_start, comma - token_start)));
+            }
+            token_start = comma + 1;
+        }
+        return names;
+    }
+
+    // Loads file_name, interning mutations into mutation_dict. Returns false if the file cannot be read.
+    bool load(const string& file_name, ThreadPool& thread_pool, MutationDictionary& mutation_dict) {
+        if (!file.open(file_name)) {
+            cerr << "Error: Could not open file " << file_name << endl;
+            return false;
+        }
+        string_view text = file.view();
+        size_t header_end = min(text.find('\n'), text.size());
+        segment_names = parse_header(text.substr(0, header_end));
+        parse_body(header_end < text.size() ? text.substr(header_end + 1) : string_view(), 1, thread_pool, mutation_dict);
+        return true;
+    }
+
+    // Loads block, whole lines that follow line first_line of a mutations CSV whose header lists seg_names
+    void load_lines(string block, const vector<string>& seg_names, size_t first_line, ThreadPool& thread_pool, MutationDictionary& mutation_dict) {
+        lines = move(block);
+        segment_names = seg_names;
+        parse_body(lines, first_line, thread_pool, mutation_dict);
+    }
+
+    // Loads block, whole lines of a mutations CSV held elsewhere, such as a mapped file, for as long as the table is used
+    void load_view(string_view block, const vector<string>& seg_names, size_t first_line, ThreadPool& thread_pool, MutationDictionary& mutation_dict) {
+        lines.clear();
+        segment_names = seg_names;
+        parse_body(block, first_line, thread_pool, mutation_dict);
+    }
+
+    const vector<string>& seg_names() const { return segment_names; }
+    size_t size() const { return sample_ids.size(); }
+    string_view date(size_t sample) const { return sample_dates[sample]; }
+    string_view id(size_t sample) const { return sample_ids[sample]; }
+
+    // Mutations of sample over all segments
+    size_t num_mutations(size_t sample) const {
+        size_t num_segs = segment_names.size();
+        return seg_offsets[(sample + 1) * num_segs] - seg_offsets[sample * num_segs];
+    }
+
+    // Puts the samples in the given order: sample i is then the one that was sample order[i]; order is a permutation of 0 .. size() - 1
+    void reorder(const vector<size_t>& order) {
+        size_t num_segs = segment_names.size();
+        vector<string_view> dates(order.size());
+        vector<string_view> ids(order.size());
+        vector<mut_id> muts;
+        vector<size_t> offsets;
+        muts.reserve(sample_muts.size());
+        offsets.reserve(seg_offsets.size());
+        offsets.push_back(0);
+        for (size_t i = 0; i < order.size(); i++) {
+            dates[i] = sample_dates[order[i]];
+            ids[i] = sample_ids[order[i]];
+            for (size_t cell = order[i] * num_segs; cell < (order[i] + 1) * num_segs; cell++) {
+                muts.insert(muts.end(), sample_muts.begin() + seg_offsets[cell], sample_muts.begin() + seg_offsets[cell + 1]);
+                offsets.push_back(muts.size());
+            }
+        }
+        sample_dates = move(dates);
+        sample_ids = move(ids);
+        sample_muts = move(muts);
+        seg_offsets = move(offsets);
+    }
+
+    // Copies the mutations of sample into mutations, one mut_set per segment
+    void get_mutations(size_t sample, vector<mut_set>& mutations) const {
+        size_t num_segs = segment_names.size();
+        mutations.resize(num_segs);
+        for (size_t seg = 0; seg < num_segs; seg++) {
+            size_t cell = sample * num_segs + seg;
+            mutations[seg].assign(sample_muts.begin() + seg_offsets[cell], sample_muts.begin() + seg_offsets[cell + 1]);
+        }
+    }
+};
+
+#endif // SAMPLE_TABLE_H
@@ -0,0 +1,224 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+
+using namespace std;
+
+// Binary snapshot of a built network. The file is a fixed header followed by flat,
+// 8-byte aligned arrays that refer to each other by element offsets, so a mapped
+// snapshot can be read in place without parsing:
+//
+//   strings     all names and dates, concatenated
+//   seg_names   StringRef per segment
+//   mutations   StringRef per mutation ID
+//   nodes       SnapshotNode per arena slot, dead slots included so handles are kept
+//   links       node_id lists: the children of every node, then parent4seg for reassortment nodes
+//   cells       uint64 offsets into muts; cell slot * S + seg holds the sample mutations of
+//               slot for segment seg, cell (num_slots + slot) * S + seg its branch mutations
+//   muts        mut_id
+//   free_slots  node_id, the arena free list
+//
+// Integers are stored in the byte order of the machine that wrote the snapshot; byte_order
+// lets a reader on another machine reject it.
+const char SNAPSHOT_MAGIC[8] = {'E', 'N', 'T', 'W', 'I', 'N', 'E', 'S'};
+const uint32_t SNAPSHOT_VERSION = 1;
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct SnapshotSection {
+    uint64_t offset = 0; // bytes from the start of the file
+    uint64_t count = 0;  // elements
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_segments;
+    uint32_t root;
+    int64_t r_index;
+    int64_t h_index;
+    SnapshotSection strings;
+    SnapshotSection seg_names;
+    SnapshotSection mutations;
+    SnapshotSection nodes;
+    SnapshotSection links;
+    SnapshotSection cells;
+    SnapshotSection muts;
+    SnapshotSection free_slots;
+};
+
+struct StringRef {
+    uint64_t offset; // into strings
+    uint64_t length;
+};
+
+const uint32_t SNAPSHOT_NODE_LIVE = 1;
+const uint32_t SNAPSHOT_NODE_REASSORTMENT = 2;
+const uint32_t SNAPSHOT_NODE_HIDDEN = 4;
+
+struct SnapshotNode {
+    StringRef name;
+    StringRef date;
+    uint64_t links_offset;   // children, followed by parent4seg if num_parent4seg > 0
+    uint32_t num_children;
+    uint32_t num_parent4seg; // 0 or num_segments
+    uint32_t parent;
+    uint32_t child_index;
+    int32_t in_degree;
+    int32_t out_degree;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+// Accumulates the sections of a snapshot and writes them out with the header
+class SnapshotWriter {
+private:
+    static void write_padded(ostream& out, const void * data, size_t size, uint64_t& offset) {
+        out.write(static_cast<const char*>(data), size);
+        offset += size;
+        static const char padding[8] = {};
+        size_t pad = (8 - offset % 8) % 8;
+        out.write(padding, pad);
+        offset += pad;
+    }
+
+    template <typename T>
+    static void write_section(ostream& out, const vector<T>& elements, SnapshotSection& section, uint64_t& offset) {
+        section.offset = offset;
+        section.count = elements.size();
+        write_padded(out, elements.data(), elements.size() * sizeof(T), offset);
+    }
+
+public:
+    SnapshotHeader header = {};
+    string strings;
+    vector<StringRef> seg_names;
+    vector<StringRef> mutations;
+    vector<SnapshotNode> nodes;
+    vector<uint32_t> links;
+    vector<uint64_t> cells{0};
+    vector<uint32_t> muts;
+    vector<uint32_t> free_slots;
+
+    StringRef add_string(const string& str) {
+        StringRef ref = {strings.size(), str.size()};
+        strings += str;
+        return ref;
+    }
+
+    // Appends the mutations of one cell
+    template <typename Set>
+    void add_cell(const Set& cell_muts) {
+        muts.insert(muts.end(), cell_muts.begin(), cell_muts.end());
+        cells.push_back(muts.size());
+    }
+
+    bool write(const string& file_name) {
+        ofstream out_file(file_name, ios::binary);
+        if (!out_file) {
+            cerr << "Error: Unable to open file " << file_name << " for writing.\n";
+            return false;
+        }
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = SNAPSHOT_VERSION;
+        header.byte_order = SNAPSHOT_BYTE_ORDER;
+        static_assert(sizeof(SnapshotHeader) % 8 == 0, "sections must stay 8-byte aligned");
+        uint64_t offset = sizeof(SnapshotHeader);
+        out_file.seekp(offset); // header goes last, once the section offsets are known
+        header.strings.offset = offset;
+        header.strings.count = strings.size();
+        write_padded(out_file, strings.data(), strings.size(), offset);
+        write_section(out_file, seg_names, header.seg_names, offset);
+        write_section(out_file, mutations, header.mutations, offset);
+        write_section(out_file, nodes, header.nodes, offset);
+        write_section(out_file, links, header.links, offset);
+        write_section(out_file, cells, header.cells, offset);
+        write_section(out_file, muts, header.muts, offset);
+        write_section(out_file, free_slots, header.free_slots, offset);
+        out_file.seekp(0);
+        out_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out_file.close();
+        if (!out_file) {
+            cerr << "Error: Failed writing snapshot " << file_name << endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+// Read-only view of a mapped snapshot. open checks the header and that every section lies
+// inside the file; references between sections are checked by the reader as it uses them.
+class SnapshotView {
+private:
+    MappedFile file;
+    const SnapshotHeader * header_ptr = nullptr;
+
+    template <typename T>
+    bool section_fits(const SnapshotSection& section) const {
+        uint64_t size = file.view().size();
+        return section.offset % alignof(T) == 0 && section.offset <= size &&
+               section.count <= (size - section.offset) / sizeof(T);
+    }
+
+public:
+    bool open(const string& file_name) {
+        if (!file.open(file_name)) {
+            cerr << "Error: Could not open file " << file_name << endl;
+            return false;
+        }
+        string_view contents = file.view();
+        if (contents.size() < sizeof(SNAPSHOT_MAGIC) || memcmp(contents.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            cerr << "Error: " << file_name << " is not an entwine snapshot" << endl;
+            return false;
+        }
+        if (contents.size() < sizeof(SnapshotHeader)) {
+            cerr << "Error: Snapshot " << file_name << " is truncated or corrupt" << endl;
+            return false;
+        }
+        header_ptr = reinterpret_cast<const SnapshotHeader*>(contents.data());
+        if (header_ptr->byte_order != SNAPSHOT_BYTE_ORDER) {
+            cerr << "Error: Snapshot " << file_name << " was written on a machine with a different byte order" << endl;
+            return false;
+        }
+        if (header_ptr->version != SNAPSHOT_VERSION) {
+            cerr << "Error: Snapshot " << file_name << " has version " << header_ptr->version << ", expected " << SNAPSHOT_VERSION << endl;
+            return false;
+        }
+        const SnapshotHeader& h = *header_ptr;
+        if (!section_fits<char>(h.strings) || !section_fits<StringRef>(h.seg_names) || !section_fits<StringRef>(h.mutations) ||
+            !section_fits<SnapshotNode>(h.nodes) || !section_fits<uint32_t>(h.links) || !section_fits<uint64_t>(h.cells) ||
+            !section_fits<uint32_t>(h.muts) || !section_fits<uint32_t>(h.free_slots) ||
+            h.seg_names.count != h.num_segments || h.cells.count != 2 * h.nodes.count * h.num_segments + 1) {
+            cerr << "Error: Snapshot " << file_name << " is truncated or corrupt" << endl;
+            return false;
+        }
+        return true;
+    }
+
+    const SnapshotHeader& header() const { return *header_ptr; }
+
+    template <typename T>
+    const T * array(const SnapshotSection& section) const {
+        return reinterpret_cast<const T*>(file.view().data() + section.offset);
+    }
+
+    bool valid_string(const StringRef& ref) const {
+        return ref.offset <= header_ptr->strings.count && ref.length <= header_ptr->strings.count - ref.offset;
+    }
+
+    string_view str(const StringRef& ref) const {
+        return string_view(array<char>(header_ptr->strings) + ref.offset, ref.length);
+    }
+};
+
+#endif // SNAPSHOT_H
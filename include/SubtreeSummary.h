@@ -0,0 +1,91 @@
+#ifndef SUBTREE_SUMMARY_H
+#define SUBTREE_SUMMARY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "MutationSet.h"
+
+using namespace std;
+
+// Bloom filter, per segment, of the mutations on every branch below a node. It may report
+// mutations that are not below the node (hash collisions, or branches removed since), but
+// never misses one that is, so a sample that shares no mutation with the summary of a node
+// matches none of the branches below it. Summaries only grow; the network keeps each one a
+// superset of the summaries and branches of the node's children (Network::summarize_branch).
+class SubtreeSummary {
+private:
+    static const size_t WORDS_PER_SEGMENT = 4; // 256 bits per segment
+    vector<uint64_t> words; // empty until the first mutation below the node is added
+
+    // The two bits of mut within the words of one segment
+    static void bits(mut_id mut, size_t& word1, uint64_t& bit1, size_t& word2, uint64_t& bit2) {
+        uint64_t hash = uint64_t(mut) * 0x9E3779B97F4A7C15ull;
+        word1 = (hash >> 62);
+        bit1 = uint64_t(1) << ((hash >> 56) & 63);
+        word2 = (hash >> 54) & 3;
+        bit2 = uint64_t(1) << ((hash >> 48) & 63);
+    }
+
+public:
+    bool empty() const { return words.empty(); }
+
+    // Adds the mutations of a branch, indexed by segment; returns whether the summary changed
+    bool add(const vector<mut_set>& branch_muts) {
+        bool changed = false;
+        for (size_t seg = 0; seg < branch_muts.size(); seg++) {
+            if (branch_muts[seg].empty()) {
+                continue;
+            }
+            if (words.empty()) {
+                words.assign(branch_muts.size() * WORDS_PER_SEGMENT, 0);
+            }
+            uint64_t * seg_words = &words[seg * WORDS_PER_SEGMENT];
+            for (mut_id mut: branch_muts[seg]) {
+                size_t word1, word2;
+                uint64_t bit1, bit2;
+                bits(mut, word1, bit1, word2, bit2);
+                changed |= (seg_words[word1] & bit1) == 0 || (seg_words[word2] & bit2) == 0;
+                seg_words[word1] |= bit1;
+                seg_words[word2] |= bit2;
+            }
+        }
+        return changed;
+    }
+
+    // Adds every mutation of other; returns whether the summary changed
+    bool add(const SubtreeSummary& other) {
+        if (other.words.empty()) {
+            return false;
+        }
+        if (words.empty()) {
+            words = other.words;
+            return true;
+        }
+        bool changed = false;
+        for (size_t i = 0; i < words.size(); i++) {
+            changed |= (other.words[i] & ~words[i]) != 0;
+            words[i] |= other.words[i];
+        }
+        return changed;
+    }
+
+    // False if no mutation of muts is below the node for segment seg
+    bool may_contain_any(size_t seg, const mut_set& muts) const {
+        if (words.empty()) {
+            return false;
+        }
+        const uint64_t * seg_words = &words[seg * WORDS_PER_SEGMENT];
+        for (mut_id mut: muts) {
+            size_t word1, word2;
+            uint64_t bit1, bit2;
+            bits(mut, word1, bit1, word2, bit2);
+            if ((seg_words[word1] & bit1) != 0 && (seg_words[word2] & bit2) != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // SUBTREE_SUMMARY_H
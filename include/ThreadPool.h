@@ -0,0 +1,120 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Fixed-size pool of worker threads. A pool of size n runs n - 1 workers; the
+// thread that calls parallel_for always takes part in the work, so a pool of
+// size 1 runs everything inline on the calling thread.
+class ThreadPool {
+private:
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+    mutex tasks_mutex;
+    condition_variable tasks_cv;
+    bool stopping = false;
+
+    void worker_loop() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(tasks_mutex);
+                tasks_cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t num_threads) {
+        for (size_t i = 1; i < num_threads; i++) {
+            workers.emplace_back(&ThreadPool::worker_loop, this);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            stopping = true;
+        }
+        tasks_cv.notify_all();
+        for (thread& worker: workers) {
+            worker.join();
+        }
+    }
+
+    size_t size() const { return workers.size() + 1; }
+
+    // Queues task to run on a worker thread (or runs it inline if there are no workers)
+    void submit(function<void()> task) {
+        if (workers.empty()) {
+            task();
+            return;
+        }
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            tasks.push(move(task));
+        }
+        tasks_cv.notify_one();
+    }
+
+    // Calls body(i) for every i in [0, count) and returns once all calls have finished.
+    // Indices are handed out dynamically; the calling thread claims indices too, so
+    // parallel_for may safely be called from inside a task running on this pool.
+    void parallel_for(size_t count, const function<void(size_t)>& body) {
+        if (workers.empty() || count <= 1) {
+            for (size_t i = 0; i < count; i++) {
+                body(i);
+            }
+            return;
+        }
+        struct Loop {
+            atomic<size_t> next_index{0};
+            size_t num_done = 0;
+            mutex done_mutex;
+            condition_variable done_cv;
+        };
+        shared_ptr<Loop> loop = make_shared<Loop>();
+        // body outlives every helper that still has an index to run, since the caller waits for them
+        auto run = [loop, count, &body]() {
+            size_t num_run = 0;
+            for (size_t i = loop->next_index++; i < count; i = loop->next_index++) {
+                body(i);
+                num_run++;
+            }
+            if (num_run > 0) {
+                lock_guard<mutex> lock(loop->done_mutex);
+                loop->num_done += num_run;
+                if (loop->num_done == count) {
+                    loop->done_cv.notify_all();
+                }
+            }
+        };
+        size_t num_helpers = min(workers.size(), count - 1);
+        for (size_t i = 0; i < num_helpers; i++) {
+            submit(run);
+        }
+        run();
+        unique_lock<mutex> lock(loop->done_mutex);
+        loop->done_cv.wait(lock, [&loop, count] { return loop->num_done == count; });
+    }
+};
+
+#endif // THREAD_POOL_H
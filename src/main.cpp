@@ -1,10 +1,32 @@
 #include "../include/Network.h"
+#include "../include/NetworkServer.h"
+#include "../include/NetworkVerifier.h"
 #include <iostream>
+#include <memory>
 #include <vector>
 
 int main(int argc, char* argv[]) {
     std::string mutations_filename = "";
     std::string network_filename = "";
+    std::string stats_filename = "";
+    std::string edges_filename = "";
+    std::string enewick_filename = "";
+    std::string snapshot_filename = "";
+    std::string base_filename = "";
+    std::string queries_filename = "";
+    std::string placements_filename = "";
+    std::string socket_path = "";
+    size_t num_threads = 1;
+    size_t batch_size = 1;
+    size_t compact_interval = 0;
+    bool subtree_summaries = false;
+    bool ancestry_index = false;
+    bool implicit_genotypes = false;
+    bool temporal_pruning = false;
+    bool serve = false;
+    bool verify = false;
+    SampleOrder sample_order = SampleOrder::file;
+    bool valid_order = true;
     // Parse command-line arguments
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
@@ -14,15 +36,188 @@ int main(int argc, char* argv[]) {
         } else if (arg == "--network" && i + 1 < argc) {        
             network_filename = argv[i + 1];
                 i++;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = std::max(1, std::atoi(argv[i + 1]));
+            i++;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch_size = std::max(1, std::atoi(argv[i + 1]));
+            i++;
+        } else if (arg == "--compact" && i + 1 < argc) {
+            compact_interval = std::max(1, std::atoi(argv[i + 1]));
+            i++;
+        } else if (arg == "--subtree-summaries") {
+            subtree_summaries = true;
+        } else if (arg == "--ancestry-index") {
+            ancestry_index = true;
+        } else if (arg == "--implicit-genotypes") {
+            implicit_genotypes = true;
+        } else if (arg == "--temporal-pruning") {
+            temporal_pruning = true;
+        } else if (arg == "--order" && i + 1 < argc) {
+            valid_order = parse_sample_order(argv[i + 1], sample_order);
+            i++;
+        } else if (arg == "--base" && i + 1 < argc) {
+            base_filename = argv[i + 1];
+            i++;
+        } else if (arg == "--place" && i + 1 < argc) {
+            queries_filename = argv[i + 1];
+            i++;
+        } else if (arg == "--placements" && i + 1 < argc) {
+            placements_filename = argv[i + 1];
+            i++;
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (arg == "--serve") {
+            serve = true;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[i + 1];
+            i++;
+        } else if (arg == "--edges" && i + 1 < argc) {
+            edges_filename = argv[i + 1];
+            i++;
+        } else if (arg == "--enewick" && i + 1 < argc) {
+            enewick_filename = argv[i + 1];
+            i++;
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshot_filename = argv[i + 1];
+            i++;
+        } else if (arg == "--stats" && i + 1 < argc) {
+            stats_filename = argv[i + 1];
+            i++;
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            log_level = std::atoi(argv[i + 1]);
+            i++;
         }
     }
 
-    if (mutations_filename.empty() || network_filename.empty()) {
-        std::cerr << "Usage: entwine --mutations <filename.csv> -- network <network.csv>" << std::endl;
+    bool place_mode = !queries_filename.empty();
+    bool verify_mode = verify && mutations_filename.empty() && !place_mode && !serve; // verify a snapshot, without grafting
+    if (!valid_order || (verify_mode ? base_filename.empty() : !serve && (place_mode ? (base_filename.empty() || placements_filename.empty()) : (mutations_filename.empty() || network_filename.empty())))) {
+        std::cerr << "Usage: entwine --mutations <filename.csv or - for stdin> --network <network.csv> [--base <base.snap>] [--order file|date|mutations|nearest] [--threads N] [--batch K] [--compact N] [--subtree-summaries] [--ancestry-index] [--implicit-genotypes] [--temporal-pruning] [--verify] [--edges <edges.tsv>] [--enewick <network.enewick>] [--snapshot <network.snap>] [--stats <stats.json>] [--log-level 0-3]" << std::endl;
+        std::cerr << "       entwine --base <base.snap> --place <queries.csv> --placements <placements.tsv> [--threads N] [--subtree-summaries] [--implicit-genotypes] [--temporal-pruning] [--stats <stats.json>] [--log-level 0-3]" << std::endl;
+        std::cerr << "       entwine --base <base.snap> --verify [--threads N]" << std::endl;
+        std::cerr << "       entwine --serve [--socket <path>] [--base <base.snap>] [--threads N] [--compact N] [--subtree-summaries] [--ancestry-index] [--implicit-genotypes] [--temporal-pruning] [--snapshot <network.snap>] [--stats <stats.json>] [--log-level 0-3]" << std::endl;
         return 1;
     }
 
-    Network NET(mutations_filename, network_filename);
+    if (verify_mode) {
+        // Consistency check of a snapshot, e.g. after an incremental update
+        Network NET(num_threads);
+        if (!NET.load_snapshot(base_filename)) {
+            return 1;
+        }
+        NetworkVerifier verifier(NET, NET.get_thread_pool());
+        bool consistent = verifier.verify();
+        verifier.report(std::cout);
+        return consistent ? 25 : 1;
+    }
+
+    if (serve) {
+        // Server: keep the network in memory and answer graft and query requests until told to stop
+        std::unique_ptr<Network> NET = std::make_unique<Network>(num_threads);
+        if (!base_filename.empty() && !NET->load_snapshot(base_filename)) {
+            return 1;
+        }
+        if (subtree_summaries) {
+            NET->enable_subtree_summaries();
+        }
+        if (ancestry_index) {
+            NET->enable_ancestry_index();
+        }
+        if (implicit_genotypes) {
+            NET->enable_implicit_genotypes();
+        }
+        if (temporal_pruning) {
+            NET->enable_temporal_pruning();
+        }
+        NET->set_compact_interval(compact_interval);
+        NetworkServer server(*NET, num_threads);
+        if (socket_path.empty()) {
+            log_level = LOG_QUIET; // stdout carries the answers
+            server.serve_stdio();
+        } else if (!server.serve_socket(socket_path)) {
+            return 1;
+        }
+        if (NET->compaction_pending()) { // as a build compacts before writing
+            NET->compact();
+        }
+        if (!snapshot_filename.empty()) {
+            NET->save_snapshot(snapshot_filename);
+        }
+        if (!stats_filename.empty()) {
+            NET->write_stats(stats_filename);
+        }
+        return 25;
+    }
+
+    if (place_mode) {
+        // Placement queries: report where samples would be grafted, leaving the base network unchanged
+        Network NET(num_threads);
+        if (!NET.load_snapshot(base_filename)) {
+            return 1;
+        }
+        if (subtree_summaries) {
+            NET.enable_subtree_summaries();
+        }
+        if (implicit_genotypes) {
+            NET.enable_implicit_genotypes();
+        }
+        if (temporal_pruning) {
+            NET.enable_temporal_pruning();
+        }
+        std::ofstream placements_file(placements_filename);
+        if (!placements_file) {
+            std::cerr << "Error: Unable to open file " << placements_filename << " for writing." << std::endl;
+            return 1;
+        }
+        NET.place_samples_from_file(queries_filename, placements_file);
+        if (!stats_filename.empty()) {
+            NET.write_stats(stats_filename);
+        }
+        return 25;
+    }
+
+    std::unique_ptr<Network> NET = std::make_unique<Network>(num_threads, batch_size);
+    // Incremental update: graft the samples that are not in the base network yet
+    if (!base_filename.empty() && !NET->load_snapshot(base_filename)) {
+        return 1;
+    }
+    if (subtree_summaries) {
+        NET->enable_subtree_summaries();
+    }
+    if (ancestry_index) {
+        NET->enable_ancestry_index();
+    }
+    if (implicit_genotypes) {
+        NET->enable_implicit_genotypes();
+    }
+    if (temporal_pruning) {
+        NET->enable_temporal_pruning();
+    }
+    NET->set_compact_interval(compact_interval);
+    NET->set_sample_order(sample_order);
+    NET->read_mutations_from_file(mutations_filename);
+    NET->write_network(network_filename);
+    if (!edges_filename.empty()) {
+        NET->write_edge_list(edges_filename);
+    }
+    if (!enewick_filename.empty()) {
+        NET->write_enewick(enewick_filename);
+    }
+    if (!snapshot_filename.empty()) {
+        NET->save_snapshot(snapshot_filename);
+    }
+    if (!stats_filename.empty()) {
+        NET->write_stats(stats_filename);
+    }
+    if (verify) {
+        NetworkVerifier verifier(*NET, NET->get_thread_pool());
+        bool consistent = verifier.verify();
+        verifier.report(std::cout);
+        if (!consistent) {
+            return 1;
+        }
+    }
 
     return 25;
 }